@@ -0,0 +1,134 @@
+/*
+ * binlog.c - Binary log of the results of 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * The file is only appended to: the header and the names of the targets
+ * are written at once when it is created, then the records are buffered
+ * in the same ring used for the text output (see output.c) and written
+ * once per batch of replies.  A file cut short (e.g. the program has been
+ * killed) is still readable up to its last complete record.
+ */
+
+
+/* Operating System header file(s) */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+/* Private header file(s) */
+#include "binlog.h"
+
+
+/* Create the file and write its header, return -1 on error (errno is set) */
+int binlog_open (binlog_t * log, char * file, char ** names, uint32_t ntargets, uint32_t cookie, uint32_t pktsize)
+{
+  binlog_head_t * head;
+  struct timespec now;
+  size_t len = sizeof (binlog_head_t);
+  size_t off;
+  uint32_t i;
+  int fd;
+
+  memset (log, '\0', sizeof (binlog_t));
+
+  /* The header and the names, padded up to the first record */
+  for (i = 0; i < ntargets; i ++)
+    len += strlen (names [i]) + 1;
+  len = (len + sizeof (binlog_rec_t) - 1) / sizeof (binlog_rec_t) * sizeof (binlog_rec_t);
+
+  if (! (head = calloc (1, len)))
+    return -1;
+
+  clock_gettime (CLOCK_REALTIME, & now);
+  memcpy (head -> magic, BINLOG_MAGIC, sizeof (head -> magic));
+  head -> version = BINLOG_VERSION;
+  head -> order = BINLOG_ORDER;
+  head -> recsize = sizeof (binlog_rec_t);
+  head -> block = BINLOG_BLOCK;
+  head -> data = len;
+  head -> ntargets = ntargets;
+  head -> start = (uint64_t) now . tv_sec * 1000000000 + now . tv_nsec;
+  head -> cookie = cookie;
+  head -> pktsize = pktsize;
+
+  off = sizeof (binlog_head_t);
+  for (i = 0; i < ntargets; i ++)
+    {
+      strcpy ((char *) head + off, names [i]);
+      off += strlen (names [i]) + 1;
+    }
+
+  if ((fd = open (file, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+    {
+      free (head);
+      return -1;
+    }
+
+  if (write (fd, head, len) != len || out_init (& log -> out, fd, BINLOG_BUF) == -1)
+    {
+      free (head);
+      close (fd);
+      return -1;
+    }
+
+  free (head);
+
+  return 0;
+}
+
+
+/* Write all the records buffered and close the file */
+void binlog_close (binlog_t * log)
+{
+  int fd = log -> out . fd;
+
+  out_free (& log -> out);
+  close (fd);
+}
+
+
+/* Write all the records buffered */
+void binlog_flush (binlog_t * log)
+{
+  out_flush (& log -> out);
+}
+
+
+/* Add the record of a reply, preceded by an index record when it is the first of a block */
+void binlog_write (binlog_t * log, binlog_rec_t * rec)
+{
+  if (! (log -> records % BINLOG_BLOCK))
+    {
+      binlog_rec_t index;
+
+      memset (& index, '\0', sizeof (index));
+      index . sent = rec -> sent + (rec -> rtt > 0 ? rec -> rtt : 0);
+      index . rtt = log -> records;
+      index . target = log -> records / BINLOG_BLOCK;
+      index . status = BINLOG_INDEX;
+      out_mem (& log -> out, (char *) & index, sizeof (index));
+    }
+
+  out_mem (& log -> out, (char *) rec, sizeof (binlog_rec_t));
+  log -> records ++;
+}
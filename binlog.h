@@ -0,0 +1,106 @@
+/*
+ * binlog.h - Binary log of the results of 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+
+/* Private header file(s) */
+#include "output.h"
+
+
+/* Identification of the file */
+#define BINLOG_MAGIC    "SPINGLOG"
+#define BINLOG_VERSION  1
+#define BINLOG_ORDER    0x01020304        /* in the byte order of the host writing the file */
+
+/* # of records between two index records */
+#define BINLOG_BLOCK    1024
+
+/* Size of the buffer of the records waiting to be written */
+#define BINLOG_BUF      (1024 * 1024)
+
+/* The status of a reply (flags) */
+#define BINLOG_OK       0x00
+#define BINLOG_BADCKSUM 0x01              /* wrong checksum                           */
+#define BINLOG_BADDATA  0x02              /* corrupted payload                        */
+#define BINLOG_DUP      0x04              /* duplicated                               */
+#define BINLOG_LATE     0x08              /* to a request no longer waited for        */
+#define BINLOG_REORDERED 0x10             /* received after the reply to a later request */
+#define BINLOG_LOST     0x20              /* not a reply: the request has been given up */
+#define BINLOG_INDEX    0xff              /* not a reply but an index record          */
+
+
+/*
+ * The header of the file (64 bytes).  It is followed by the names of the
+ * targets as given by the user (each one terminated by a '\0', in the order
+ * of their index, padded with '\0' up to the first record) and by the records.
+ */
+typedef struct
+{
+  char magic [8];                 /* BINLOG_MAGIC (not terminated)            */
+  uint32_t version;               /* BINLOG_VERSION                           */
+  uint32_t order;                 /* BINLOG_ORDER                             */
+  uint32_t recsize;               /* size of a record                         */
+  uint32_t block;                 /* # of records between two index records   */
+  uint32_t data;                  /* offset of the first record               */
+  uint32_t ntargets;              /* # of targets                             */
+  uint64_t start;                 /* time the file was created (nsec since the Epoch) */
+  uint32_t cookie;                /* cookie of the session                    */
+  uint32_t pktsize;               /* size of the requests (ICMP plus User Data) */
+  uint8_t spare [16];
+} binlog_head_t;
+
+
+/*
+ * A record (32 bytes).  The records are all of the same size, so the n-th
+ * is at offset data + n * recsize and the file can be mapped and read as
+ * an array.  Each block of BINLOG_BLOCK replies starts with an index record
+ * holding the time the first of them has been received, so that a reader
+ * can binary search the records by time.
+ */
+typedef struct
+{
+  uint64_t sent;                  /* time the request was sent (nsec since the Epoch), index: time the block starts */
+  int64_t rtt;                    /* round-trip time (nsec), index: # of replies before the block */
+  uint32_t target;                /* index in the table of targets, index: # of the block */
+  uint32_t txdelay;               /* in-host send delay (nsec), 0 if not known */
+  uint16_t seq;                   /* sequence number                          */
+  uint16_t size;                  /* # of bytes of the reply (ICMP plus User Data) */
+  uint8_t ttl;                    /* time to live of the reply                */
+  uint8_t status;                 /* BINLOG_OK or flags, BINLOG_INDEX         */
+  uint16_t epoch;                 /* # of times the sequence number wrapped (low 16 bits) */
+} binlog_rec_t;
+
+
+/* A binary log being written */
+typedef struct
+{
+  out_t out;                      /* records waiting to be written            */
+  uint64_t records;               /* # of replies logged                      */
+} binlog_t;
+
+
+int binlog_open (binlog_t * log, char * file, char ** names, uint32_t ntargets, uint32_t cookie, uint32_t pktsize);
+void binlog_close (binlog_t * log);
+void binlog_flush (binlog_t * log);
+void binlog_write (binlog_t * log, binlog_rec_t * rec);
@@ -0,0 +1,145 @@
+/*
+ * cksum-bench.c - Microbenchmark of the Internet checksum kernels of 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/* Operating System header file(s) */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Private header file(s) */
+#include "cksum.h"
+
+
+/* Sizes of the buffers (in bytes) and total # of bytes to checksum for each of them */
+#define MIN_SIZE  64
+#define MAX_SIZE  (64 * 1024)
+#define VOLUME    (256 * 1024 * 1024)
+
+
+/* The original routine, wrapped as a kernel (it returns the complemented sum) */
+static uint16_t stevens (const void * buf, size_t len)
+{
+  return ~mkcksum ((u_short *) buf, len);
+}
+
+
+static struct
+{
+  char * name;
+  cksum_fn_t * fn;
+} kernels [] =
+{
+  { "mkcksum", stevens      },
+  { "scalar",  cksum_scalar },
+  { "sse2",    cksum_sse2   },
+  { "avx2",    cksum_avx2   },
+};
+
+#define NKERNELS (sizeof (kernels) / sizeof (kernels [0]))
+
+
+/* Return the current time (in nanoseconds) */
+static double now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, & ts);
+
+  return ts . tv_sec * 1e9 + ts . tv_nsec;
+}
+
+
+/* Time the kernels over buffers of sizes from 64B to 64KB (and one odd byte more) */
+int main (int argc, char * argv [])
+{
+  u_char * buf = malloc (MAX_SIZE + 1 + 1);
+  const char * best;
+  int usable = 0;
+  size_t size;
+  size_t i;
+  int k;
+
+  /* Notice the program name */
+  char * progname = strrchr (argv [0], '/');
+  progname = ! progname ? * argv : progname + 1;
+
+  /* The kernels are sorted, those after the best are not supported by this CPU */
+  cksum_best (& best);
+  while (strcmp (kernels [usable] . name, best))
+    usable ++;
+  printf ("%s: best kernel for this CPU is %s\n\n", progname, best);
+
+  /* Unaligned by one byte on purpose */
+  srand (1);
+  for (i = 0; i < MAX_SIZE + 1; i ++)
+    buf [i + 1] = rand ();
+
+  printf ("%8s", "bytes");
+  for (k = 0; k < NKERNELS; k ++)
+    printf (" %16s", kernels [k] . name);
+  printf ("   (ns per call, GB/s)\n");
+
+  for (size = MIN_SIZE; size <= MAX_SIZE; size *= 2)
+    {
+      size_t sizes [2] = { size, size + 1 };
+      int s;
+
+      for (s = 0; s < 2; s ++)
+	{
+	  uint16_t expected = kernels [0] . fn (buf + 1, sizes [s]);
+	  long loops = VOLUME / sizes [s];
+
+	  printf ("%8zu", sizes [s]);
+	  for (k = 0; k < NKERNELS; k ++)
+	    {
+	      volatile uint16_t sum = 0;
+	      double start;
+	      double elapsed;
+	      long l;
+
+	      if (k > usable)
+		{
+		  printf (" %16s", "n/a");
+		  continue;
+		}
+
+	      if (kernels [k] . fn (buf + 1, sizes [s]) != expected)
+		{
+		  printf ("\n%s: kernel %s computes a wrong sum over %zu bytes\n", progname, kernels [k] . name, sizes [s]);
+		  return 1;
+		}
+
+	      start = now ();
+	      for (l = 0; l < loops; l ++)
+		sum += kernels [k] . fn (buf + 1, sizes [s]);
+	      elapsed = now () - start;
+
+	      printf (" %9.1f %6.2f", elapsed / loops, (double) loops * sizes [s] / elapsed);
+	    }
+	  printf ("\n");
+	}
+    }
+
+  free (buf);
+
+  return 0;
+}
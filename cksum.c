@@ -0,0 +1,260 @@
+/*
+ * cksum.c - Internet checksum for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * The ones complement sum of 16-bit words does not depend on the size of
+ * the words actually added (RFC 1071), as far as the carries are added
+ * back in the end.  So the kernels here add 32-bit words into 64-bit
+ * accumulators (which never overflow for any packet) and fold them down
+ * to 16 bits only once: scalar, 4 words at a time with SSE2 and 8 words
+ * at a time with AVX2.  The best one is selected at runtime with CPUID.
+ */
+
+
+/* Operating System header file(s) */
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86
+#endif
+
+/* Private header file(s) */
+#include "cksum.h"
+
+
+/* Fold a 64-bit ones complement sum down to 16 bits */
+static uint16_t fold (uint64_t sum)
+{
+  sum = (sum >> 32) + (sum & 0xffffffff);
+  sum = (sum >> 32) + (sum & 0xffffffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+
+  return sum;
+}
+
+
+/* Add the last (less than 4) bytes of a buffer */
+static uint64_t tail (const u_char * p, size_t len, uint64_t sum)
+{
+  uint16_t word = 0;
+
+  if (len >= 2)
+    {
+      memcpy (& word, p, 2);
+      sum += word;
+      p += 2;
+      len -= 2;
+    }
+
+  /* mop up an odd byte, if necessary */
+  if (len)
+    {
+      word = 0;
+      * (u_char *) & word = * p;
+      sum += word;
+    }
+
+  return sum;
+}
+
+
+/*
+ * Checksum routine for Internet Protocol family headers (C Version).
+ * From ping examples in W. Richard Stevens "Unix Network Programming" book
+ */
+int mkcksum (u_short * p, int n)
+{
+  u_short answer;
+  long sum = 0;
+  u_short odd_byte = 0;
+
+  while (n > 1)
+    {
+      sum += * p ++;
+      n -= 2;
+    }
+
+  /* mop up an odd byte, if necessary */
+  if (n == 1)
+    {
+      * (u_char *) (& odd_byte) = * (u_char *) p;
+      sum += odd_byte;
+    }
+
+  sum = (sum >> 16) + (sum & 0xffff);	/* add high 16 to low 16 */
+  sum += (sum >> 16);			/* add carry */
+  answer = ~sum;			/* ones-complement, truncate */
+
+  return answer;
+}
+
+
+/* 32 bits at a time into a 64-bit accumulator */
+uint16_t cksum_scalar (const void * buf, size_t len)
+{
+  const u_char * p = buf;
+  uint64_t sum = 0;
+  uint32_t word;
+
+  for (; len >= 4; p += 4, len -= 4)
+    {
+      memcpy (& word, p, 4);
+      sum += word;
+    }
+
+  return fold (tail (p, len, sum));
+}
+
+
+#if defined(X86)
+
+/* 4 x 32 bits at a time (zero extended to 64-bit lanes) */
+__attribute__ ((target ("sse2")))
+uint16_t cksum_sse2 (const void * buf, size_t len)
+{
+  const u_char * p = buf;
+  __m128i zero = _mm_setzero_si128 ();
+  __m128i acc0 = zero;
+  __m128i acc1 = zero;
+  uint64_t lanes [2];
+  uint64_t sum;
+  uint32_t word;
+
+  for (; len >= 32; p += 32, len -= 32)
+    {
+      __m128i v0 = _mm_loadu_si128 ((const __m128i *) p);
+      __m128i v1 = _mm_loadu_si128 ((const __m128i *) (p + 16));
+
+      acc0 = _mm_add_epi64 (acc0, _mm_unpacklo_epi32 (v0, zero));
+      acc1 = _mm_add_epi64 (acc1, _mm_unpackhi_epi32 (v0, zero));
+      acc0 = _mm_add_epi64 (acc0, _mm_unpacklo_epi32 (v1, zero));
+      acc1 = _mm_add_epi64 (acc1, _mm_unpackhi_epi32 (v1, zero));
+    }
+
+  _mm_storeu_si128 ((__m128i *) lanes, _mm_add_epi64 (acc0, acc1));
+  sum = fold (lanes [0]) + fold (lanes [1]);
+
+  for (; len >= 4; p += 4, len -= 4)
+    {
+      memcpy (& word, p, 4);
+      sum += word;
+    }
+
+  return fold (tail (p, len, sum));
+}
+
+
+/* 8 x 32 bits at a time (zero extended to 64-bit lanes) */
+__attribute__ ((target ("avx2")))
+uint16_t cksum_avx2 (const void * buf, size_t len)
+{
+  const u_char * p = buf;
+  __m256i zero = _mm256_setzero_si256 ();
+  __m256i acc0 = zero;
+  __m256i acc1 = zero;
+  uint64_t lanes [4];
+  uint64_t sum;
+  uint32_t word;
+
+  for (; len >= 64; p += 64, len -= 64)
+    {
+      __m256i v0 = _mm256_loadu_si256 ((const __m256i *) p);
+      __m256i v1 = _mm256_loadu_si256 ((const __m256i *) (p + 32));
+
+      acc0 = _mm256_add_epi64 (acc0, _mm256_unpacklo_epi32 (v0, zero));
+      acc1 = _mm256_add_epi64 (acc1, _mm256_unpackhi_epi32 (v0, zero));
+      acc0 = _mm256_add_epi64 (acc0, _mm256_unpacklo_epi32 (v1, zero));
+      acc1 = _mm256_add_epi64 (acc1, _mm256_unpackhi_epi32 (v1, zero));
+    }
+
+  _mm256_storeu_si256 ((__m256i *) lanes, _mm256_add_epi64 (acc0, acc1));
+  sum = (uint64_t) fold (lanes [0]) + fold (lanes [1]) + fold (lanes [2]) + fold (lanes [3]);
+
+  for (; len >= 4; p += 4, len -= 4)
+    {
+      memcpy (& word, p, 4);
+      sum += word;
+    }
+
+  return fold (tail (p, len, sum));
+}
+
+#else
+
+/* Not an x86 CPU, fall back to the scalar kernel */
+uint16_t cksum_sse2 (const void * buf, size_t len)
+{
+  return cksum_scalar (buf, len);
+}
+
+
+uint16_t cksum_avx2 (const void * buf, size_t len)
+{
+  return cksum_scalar (buf, len);
+}
+
+#endif /* X86 */
+
+
+/* The best kernel for the CPU the program is running on (as CPUID tells) */
+cksum_fn_t * cksum_best (const char ** name)
+{
+#if defined(X86)
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    {
+      if (name)
+	* name = "avx2";
+      return cksum_avx2;
+    }
+  if (__builtin_cpu_supports ("sse2"))
+    {
+      if (name)
+	* name = "sse2";
+      return cksum_sse2;
+    }
+#endif /* X86 */
+
+  if (name)
+    * name = "scalar";
+  return cksum_scalar;
+}
+
+
+/* Ones complement sum of a buffer (the kernel is selected the first time) */
+uint16_t cksum_sum (const void * buf, size_t len)
+{
+  static cksum_fn_t * kernel;
+
+  if (! kernel)
+    kernel = cksum_best (NULL);
+
+  return kernel (buf, len);
+}
+
+
+/* Internet checksum of a buffer */
+uint16_t cksum (const void * buf, size_t len)
+{
+  return ~cksum_sum (buf, len);
+}
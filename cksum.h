@@ -0,0 +1,47 @@
+/*
+ * cksum.h - Internet checksum for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/* A kernel computing the ones complement sum of a buffer (folded to 16 bits, not complemented) */
+typedef uint16_t cksum_fn_t (const void * buf, size_t len);
+
+
+/* The original 16-bit-at-a-time routine */
+int mkcksum (u_short * p, int n);
+
+/* The kernels available */
+uint16_t cksum_scalar (const void * buf, size_t len);
+uint16_t cksum_sse2 (const void * buf, size_t len);
+uint16_t cksum_avx2 (const void * buf, size_t len);
+
+/* The best kernel for the CPU the program is running on (and its name) */
+cksum_fn_t * cksum_best (const char ** name);
+
+/* Ones complement sum and Internet checksum with the best kernel */
+uint16_t cksum_sum (const void * buf, size_t len);
+uint16_t cksum (const void * buf, size_t len);
@@ -0,0 +1,243 @@
+/*
+ * filter.c - In-kernel packet filter for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * A raw ICMP socket receives a copy of every ICMP packet to the host.
+ * The classic BPF program generated here runs in the kernel on each of
+ * them (starting with the IP header) and accepts only:
+ *  o the echo replies carrying one of our identifiers and the cookie of the session
+ *  o optionally, the ICMP errors (destination unreachable, time exceeded and
+ *    parameter problem) quoting an echo request carrying one of our identifiers
+ *
+ * so that any other packet never wakes up the program nor costs a copy.
+ *
+ * A packet socket (see ring.c) receives every IP packet instead, in and out:
+ * the same program is preceded by a check that the packet is an incoming
+ * ICMP one (and not a fragment following the first).
+ *
+ * When the packet sockets of several threads are in a fanout group, another
+ * program tells the kernel which one of them each packet is for, by its
+ * identifier, so that it is filtered and copied only once.
+ *
+ * Note that classic BPF loads halfwords and words in network byte order.
+ */
+
+
+/* Operating System header file(s) */
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <linux/if_packet.h>
+
+/* Private header file(s) */
+#include "filter.h"
+
+
+/* Accept the whole packet or drop it */
+#define ACCEPT  0xffffffff
+#define DROP    0
+
+
+/* Add an instruction */
+#define STMT(code, k)          prog [n ++] = (struct sock_filter) BPF_STMT (code, k)
+#define JUMP(code, k, jt, jf)  prog [n ++] = (struct sock_filter) BPF_JUMP (code, k, jt, jf)
+
+
+/* Generate the filter, return the # of instructions */
+int mkfilter (struct sock_filter * prog, uint16_t * ids, int nids, uint32_t cookie, int errors)
+{
+  int n = 0;
+  int i;
+  int reply;                            /* index of the jump to patch when not an echo reply */
+  int cookies;                          /* index of the check of the cookie */
+  int matched [MAX_FILTER_IDS];         /* index of the checks of the identifiers */
+
+  if (nids > MAX_FILTER_IDS)
+    nids = MAX_FILTER_IDS;
+
+  /* X = length of the IP header, A = ICMP type */
+  STMT (BPF_LDX | BPF_B | BPF_MSH, 0);
+  STMT (BPF_LD | BPF_B | BPF_IND, 0);
+  reply = n;
+  JUMP (BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHOREPLY, 0, 0);
+
+  /* An echo reply: one of our identifiers */
+  STMT (BPF_LD | BPF_H | BPF_IND, 4);
+  for (i = 0; i < nids; i ++)
+    {
+      matched [i] = n;
+      JUMP (BPF_JMP | BPF_JEQ | BPF_K, ntohs (ids [i]), 0, 0);
+    }
+  STMT (BPF_RET | BPF_K, DROP);
+
+  /* and the cookie at the beginning of the payload */
+  cookies = n;
+  for (i = 0; i < nids; i ++)
+    prog [matched [i]] . jt = cookies - matched [i] - 1;
+  STMT (BPF_LD | BPF_W | BPF_IND, ICMP_MINLEN);
+  JUMP (BPF_JMP | BPF_JEQ | BPF_K, ntohl (cookie), 0, 1);
+  STMT (BPF_RET | BPF_K, ACCEPT);
+  STMT (BPF_RET | BPF_K, DROP);
+
+  /* Not an echo reply */
+  prog [reply] . jf = n - reply - 1;
+  if (errors)
+    {
+      /* A = ICMP type again */
+      JUMP (BPF_JMP | BPF_JEQ | BPF_K, ICMP_DEST_UNREACH, 3, 0);
+      JUMP (BPF_JMP | BPF_JEQ | BPF_K, ICMP_TIME_EXCEEDED, 2, 0);
+      JUMP (BPF_JMP | BPF_JEQ | BPF_K, ICMP_PARAMETERPROB, 1, 0);
+      STMT (BPF_RET | BPF_K, DROP);
+
+      /* X = offset of the ICMP header quoted after the IP header quoted in the error */
+      STMT (BPF_LD | BPF_B | BPF_IND, ICMP_MINLEN);
+      STMT (BPF_ALU | BPF_AND | BPF_K, 0x0f);
+      STMT (BPF_ALU | BPF_LSH | BPF_K, 2);
+      STMT (BPF_ALU | BPF_ADD | BPF_K, ICMP_MINLEN);
+      STMT (BPF_ALU | BPF_ADD | BPF_X, 0);
+      STMT (BPF_MISC | BPF_TAX, 0);
+
+      /* An echo request with one of our identifiers */
+      STMT (BPF_LD | BPF_B | BPF_IND, 0);
+      JUMP (BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHO, 1, 0);
+      STMT (BPF_RET | BPF_K, DROP);
+      STMT (BPF_LD | BPF_H | BPF_IND, 4);
+      for (i = 0; i < nids; i ++)
+	JUMP (BPF_JMP | BPF_JEQ | BPF_K, ntohs (ids [i]), nids - i, 0);
+      STMT (BPF_RET | BPF_K, DROP);
+      STMT (BPF_RET | BPF_K, ACCEPT);
+    }
+  else
+    STMT (BPF_RET | BPF_K, DROP);
+
+  return n;
+}
+
+
+/* Generate the filter and attach it to a socket */
+int attach_filter (int fd, uint16_t * ids, int nids, uint32_t cookie, int errors)
+{
+  struct sock_filter prog [MAX_FILTER_LEN];
+  struct sock_fprog fprog = { 0, prog };
+
+  fprog . len = mkfilter (prog, ids, nids, cookie, errors);
+
+  return setsockopt (fd, SOL_SOCKET, SO_ATTACH_FILTER, & fprog, sizeof (fprog));
+}
+
+
+/* Generate the filter for a packet socket (starting with the IP header) and attach it */
+int attach_packet_filter (int fd, uint16_t * ids, int nids, uint32_t cookie, int errors)
+{
+  struct sock_filter prog [MAX_FILTER_LEN + 8];
+  struct sock_fprog fprog = { 0, prog };
+  int n = 0;
+
+  /* Not sent by this host */
+  STMT (BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE);
+  JUMP (BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 4, 0);
+
+  /* ICMP, the first fragment (if any) */
+  STMT (BPF_LD | BPF_B | BPF_ABS, 9);
+  JUMP (BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP, 0, 2);
+  STMT (BPF_LD | BPF_H | BPF_ABS, 6);
+  JUMP (BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 0, 1);
+  STMT (BPF_RET | BPF_K, DROP);
+
+  fprog . len = n + mkfilter (prog + n, ids, nids, cookie, errors);
+
+  return setsockopt (fd, SOL_SOCKET, SO_ATTACH_FILTER, & fprog, sizeof (fprog));
+}
+
+
+/* Attach a filter dropping all the packets, to a socket used only to transmit */
+int attach_drop_filter (int fd)
+{
+  struct sock_filter prog [1];
+  struct sock_fprog fprog = { 0, prog };
+  int n = 0;
+
+  STMT (BPF_RET | BPF_K, DROP);
+  fprog . len = n;
+
+  return setsockopt (fd, SOL_SOCKET, SO_ATTACH_FILTER, & fprog, sizeof (fprog));
+}
+
+
+/*
+ * Attach to a fanout group (in PACKET_FANOUT_CBPF mode) the program returning,
+ * for each packet, the index of the member it is for: that of the identifier
+ * carried by an echo reply (or quoted by an ICMP error, with -e) among ids,
+ * the identifiers of the members in the order they have joined the group.
+ * Any other packet goes to the first one, whose own filter drops it.
+ */
+int attach_fanout_filter (int fd, uint16_t * ids, int nids, int errors)
+{
+  struct sock_filter prog [16 + 2 * MAX_FILTER_IDS];
+  struct sock_fprog fprog = { 0, prog };
+  int n = 0;
+  int i;
+  int reply;
+
+  if (nids > MAX_FILTER_IDS)
+    nids = MAX_FILTER_IDS;
+
+  /* X = length of the IP header, A = ICMP type */
+  STMT (BPF_LDX | BPF_B | BPF_MSH, 0);
+  STMT (BPF_LD | BPF_B | BPF_IND, 0);
+  reply = n;
+  JUMP (BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHOREPLY, 0, 0);
+
+  if (errors)
+    {
+      JUMP (BPF_JMP | BPF_JEQ | BPF_K, ICMP_DEST_UNREACH, 3, 0);
+      JUMP (BPF_JMP | BPF_JEQ | BPF_K, ICMP_TIME_EXCEEDED, 2, 0);
+      JUMP (BPF_JMP | BPF_JEQ | BPF_K, ICMP_PARAMETERPROB, 1, 0);
+      STMT (BPF_RET | BPF_K, 0);
+
+      /* X = offset of the ICMP header quoted after the IP header quoted in the error */
+      STMT (BPF_LD | BPF_B | BPF_IND, ICMP_MINLEN);
+      STMT (BPF_ALU | BPF_AND | BPF_K, 0x0f);
+      STMT (BPF_ALU | BPF_LSH | BPF_K, 2);
+      STMT (BPF_ALU | BPF_ADD | BPF_K, ICMP_MINLEN);
+      STMT (BPF_ALU | BPF_ADD | BPF_X, 0);
+      STMT (BPF_MISC | BPF_TAX, 0);
+      prog [reply] . jt = n - reply - 1;
+    }
+  else
+    {
+      prog [reply] . jt = 1;
+      STMT (BPF_RET | BPF_K, 0);
+    }
+
+  /* The member by identifier */
+  STMT (BPF_LD | BPF_H | BPF_IND, 4);
+  for (i = 0; i < nids; i ++)
+    {
+      JUMP (BPF_JMP | BPF_JEQ | BPF_K, ntohs (ids [i]), 0, 1);
+      STMT (BPF_RET | BPF_K, i);
+    }
+  STMT (BPF_RET | BPF_K, 0);
+
+  fprog . len = n;
+
+  return setsockopt (fd, SOL_PACKET, PACKET_FANOUT_DATA, & fprog, sizeof (fprog));
+}
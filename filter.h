@@ -0,0 +1,40 @@
+/*
+ * filter.h - In-kernel packet filter for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+#include <linux/filter.h>
+
+
+/* Max # of echo identifiers a filter could accept */
+#define MAX_FILTER_IDS  64
+
+/* Max # of instructions of a filter */
+#define MAX_FILTER_LEN  (32 + 2 * MAX_FILTER_IDS)
+
+
+int mkfilter (struct sock_filter * prog, uint16_t * ids, int nids, uint32_t cookie, int errors);
+int attach_filter (int fd, uint16_t * ids, int nids, uint32_t cookie, int errors);
+int attach_packet_filter (int fd, uint16_t * ids, int nids, uint32_t cookie, int errors);
+int attach_drop_filter (int fd);
+int attach_fanout_filter (int fd, uint16_t * ids, int nids, int errors);
@@ -0,0 +1,357 @@
+/*
+ * neigh.c - Next hops and their link-layer addresses for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Frames sent through a packet socket (see txring.c) bypass the IP stack,
+ * so their link-layer header must be filled in here: the route to each
+ * destination (its next hop and interface) is matched against the routes
+ * read at once from the kernel over rtnetlink, as ip route show does, and
+ * its source address is asked to the kernel, as ip route get does, only
+ * once per route.  The link-layer address of the next hop is looked up in
+ * the neighbour table of the kernel, read at once too.  When not there yet,
+ * the kernel is asked to resolve it by sending a datagram to the next hop
+ * (to the discard port) through the IP stack.
+ */
+
+
+/* Operating System header file(s) */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+/* Private header file(s) */
+#include "neigh.h"
+
+
+/* The discard service */
+#define DISCARD         9
+
+
+/* The longest prefixes first, those of the local table first among the same length */
+static int bylen (const void * a, const void * b)
+{
+  const route_t * r1 = a;
+  const route_t * r2 = b;
+
+  if (r1 -> len != r2 -> len)
+    return r2 -> len - r1 -> len;
+  return (r2 -> table == RT_TABLE_LOCAL) - (r1 -> table == RT_TABLE_LOCAL);
+}
+
+
+/* Add a route, as read from the kernel, return -1 when out of memory */
+static int addroute (routes_t * routes, struct nlmsghdr * nh)
+{
+  struct rtmsg * rt = NLMSG_DATA (nh);
+  struct rtattr * rta;
+  uint32_t table = rt -> rtm_table;
+  route_t r;
+  int len;
+
+  memset (& r, '\0', sizeof (r));
+  len = RTM_PAYLOAD (nh);
+  for (rta = RTM_RTA (rt); RTA_OK (rta, len); rta = RTA_NEXT (rta, len))
+    switch (rta -> rta_type)
+      {
+      case RTA_TABLE:
+	table = * (uint32_t *) RTA_DATA (rta);
+	break;
+      case RTA_DST:
+	memcpy (& r . dst, RTA_DATA (rta), sizeof (struct in_addr));
+	break;
+      case RTA_OIF:
+	r . ifindex = * (int *) RTA_DATA (rta);
+	break;
+      case RTA_GATEWAY:
+	memcpy (& r . gateway, RTA_DATA (rta), sizeof (struct in_addr));
+	break;
+      case RTA_PREFSRC:
+	memcpy (& r . src, RTA_DATA (rta), sizeof (struct in_addr));
+	break;
+      }
+
+  /* Only the tables the kernel looks up without any rule of its own */
+  if (table != RT_TABLE_LOCAL && table != RT_TABLE_MAIN)
+    return 0;
+
+  r . len = rt -> rtm_dst_len;
+  r . mask = r . len ? htonl (0xffffffff << (32 - r . len)) : 0;
+  r . type = rt -> rtm_type;
+  r . table = table;
+
+  /* Room for twice as many each time it is full, the # of routes is a power of 2 then */
+  if (! (routes -> count & (routes -> count - 1)))
+    {
+      route_t * more = realloc (routes -> routes, (routes -> count ? routes -> count * 2 : 1) * sizeof (route_t));
+      if (! more)
+	return -1;
+      routes -> routes = more;
+    }
+  routes -> routes [routes -> count ++] = r;
+
+  return 0;
+}
+
+
+/* Read all the routes from the kernel, return -1 on error */
+int neigh_routes (routes_t * routes)
+{
+  struct
+  {
+    struct nlmsghdr nh;
+    struct rtmsg rt;
+  } req;
+  u_char buf [32768];
+  int done = 0;
+  int fd;
+
+  routes -> routes = NULL;
+  routes -> count = 0;
+
+  if ((fd = socket (AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_ROUTE)) == -1)
+    return -1;
+
+  memset (& req, '\0', sizeof (req));
+  req . nh . nlmsg_len = NLMSG_LENGTH (sizeof (struct rtmsg));
+  req . nh . nlmsg_type = RTM_GETROUTE;
+  req . nh . nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  req . rt . rtm_family = AF_INET;
+
+  if (send (fd, & req, req . nh . nlmsg_len, 0) == -1)
+    done = -1;
+
+  /* The routes come in as many datagrams as needed, up to the last one */
+  while (! done)
+    {
+      struct nlmsghdr * nh = (struct nlmsghdr *) buf;
+      int len = recv (fd, buf, sizeof (buf), 0);
+
+      if (len == -1)
+	done = -1;
+      for (; done == 0 && NLMSG_OK (nh, len); nh = NLMSG_NEXT (nh, len))
+	if (nh -> nlmsg_type == NLMSG_DONE)
+	  done = 1;
+	else if (nh -> nlmsg_type == NLMSG_ERROR || (nh -> nlmsg_type == RTM_NEWROUTE && addroute (routes, nh) == -1))
+	  done = -1;
+    }
+  close (fd);
+
+  if (done == -1)
+    {
+      neigh_routes_free (routes);
+      return -1;
+    }
+
+  qsort (routes -> routes, routes -> count, sizeof (route_t), bylen);
+
+  return 0;
+}
+
+
+/* Return the route the kernel would take to a destination, NULL if none */
+route_t * neigh_match (routes_t * routes, struct in_addr dst)
+{
+  uint32_t i;
+
+  for (i = 0; i < routes -> count; i ++)
+    if ((dst . s_addr & routes -> routes [i] . mask) == routes -> routes [i] . dst . s_addr)
+      return & routes -> routes [i];
+
+  return NULL;
+}
+
+
+void neigh_routes_free (routes_t * routes)
+{
+  free (routes -> routes);
+  routes -> routes = NULL;
+  routes -> count = 0;
+}
+
+
+/*
+ * Ask the kernel the route to a destination: the interface, the next hop
+ * (the destination itself when directly connected) and the source address,
+ * return -1 when there is none
+ */
+int neigh_route (struct in_addr dst, int * ifindex, struct in_addr * gateway, struct in_addr * src)
+{
+  struct
+  {
+    struct nlmsghdr nh;
+    struct rtmsg rt;
+    u_char attrs [RTA_SPACE (sizeof (struct in_addr))];
+  } req;
+  u_char buf [4096];
+  struct nlmsghdr * nh = (struct nlmsghdr *) buf;
+  struct rtattr * rta;
+  int len;
+  int fd;
+
+  if ((fd = socket (AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_ROUTE)) == -1)
+    return -1;
+
+  memset (& req, '\0', sizeof (req));
+  req . nh . nlmsg_len = NLMSG_LENGTH (sizeof (struct rtmsg)) + RTA_SPACE (sizeof (struct in_addr));
+  req . nh . nlmsg_type = RTM_GETROUTE;
+  req . nh . nlmsg_flags = NLM_F_REQUEST;
+  req . rt . rtm_family = AF_INET;
+  req . rt . rtm_dst_len = 32;
+  rta = (struct rtattr *) req . attrs;
+  rta -> rta_type = RTA_DST;
+  rta -> rta_len = RTA_LENGTH (sizeof (struct in_addr));
+  memcpy (RTA_DATA (rta), & dst, sizeof (struct in_addr));
+
+  if (send (fd, & req, req . nh . nlmsg_len, 0) == -1 || (len = recv (fd, buf, sizeof (buf), 0)) == -1)
+    {
+      close (fd);
+      return -1;
+    }
+  close (fd);
+
+  if (! NLMSG_OK (nh, len) || nh -> nlmsg_type != RTM_NEWROUTE)
+    return -1;
+
+  * ifindex = 0;
+  * gateway = dst;
+  src -> s_addr = INADDR_ANY;
+
+  len = RTM_PAYLOAD (nh);
+  for (rta = RTM_RTA (NLMSG_DATA (nh)); RTA_OK (rta, len); rta = RTA_NEXT (rta, len))
+    switch (rta -> rta_type)
+      {
+      case RTA_OIF:
+	* ifindex = * (int *) RTA_DATA (rta);
+	break;
+      case RTA_GATEWAY:
+	memcpy (gateway, RTA_DATA (rta), sizeof (struct in_addr));
+	break;
+      case RTA_PREFSRC:
+	memcpy (src, RTA_DATA (rta), sizeof (struct in_addr));
+	break;
+      }
+
+  return * ifindex ? 0 : -1;
+}
+
+
+/* By address */
+static int byaddr (const void * a, const void * b)
+{
+  uint32_t a1 = ntohl (((const neigh_t *) a) -> addr . s_addr);
+  uint32_t a2 = ntohl (((const neigh_t *) b) -> addr . s_addr);
+
+  return a1 < a2 ? -1 : a1 > a2;
+}
+
+
+/* Read at once the neighbours on an interface whose link-layer address is known, return -1 on error */
+int neigh_read (neighs_t * neighs, char * iface)
+{
+  FILE * fp = fopen ("/proc/net/arp", "r");
+  char line [256];
+  char ip [INET_ADDRSTRLEN];
+  char hw [32];
+  char dev [32];
+  unsigned flags;
+  unsigned m [6];
+  uint32_t size = 0;
+  int i;
+
+  neigh_free (neighs);
+  if (! fp)
+    return -1;
+
+  /* IP address, HW type, Flags, HW address, Mask, Device */
+  while (fgets (line, sizeof (line), fp))
+    if (sscanf (line, "%15s %*s %x %31s %*s %31s", ip, & flags, hw, dev) == 4 &&
+	(flags & 0x02) && ! strcmp (dev, iface) &&
+	sscanf (hw, "%x:%x:%x:%x:%x:%x", & m [0], & m [1], & m [2], & m [3], & m [4], & m [5]) == 6)
+      {
+	neigh_t * n;
+
+	if (neighs -> count == size)
+	  {
+	    neigh_t * more = realloc (neighs -> neighs, (size ? size * 2 : 64) * sizeof (neigh_t));
+	    if (! more)
+	      break;
+	    neighs -> neighs = more;
+	    size = size ? size * 2 : 64;
+	  }
+	n = & neighs -> neighs [neighs -> count ++];
+	n -> addr . s_addr = inet_addr (ip);
+	for (i = 0; i < 6; i ++)
+	  n -> mac [i] = m [i];
+      }
+
+  fclose (fp);
+
+  qsort (neighs -> neighs, neighs -> count, sizeof (neigh_t), byaddr);
+
+  return 0;
+}
+
+
+/* Look up the link-layer address of a neighbour in those read, return -1 when not (yet) known */
+int neigh_lookup (neighs_t * neighs, struct in_addr addr, u_char * mac)
+{
+  neigh_t key;
+  neigh_t * n;
+
+  key . addr = addr;
+  if (! neighs -> count || ! (n = bsearch (& key, neighs -> neighs, neighs -> count, sizeof (neigh_t), byaddr)))
+    return -1;
+
+  memcpy (mac, n -> mac, ETH_ALEN);
+
+  return 0;
+}
+
+
+void neigh_free (neighs_t * neighs)
+{
+  free (neighs -> neighs);
+  neighs -> neighs = NULL;
+  neighs -> count = 0;
+}
+
+
+/* Have the kernel resolve the link-layer address of a neighbour */
+void neigh_solicit (struct in_addr addr)
+{
+  struct sockaddr_in sa;
+  int fd;
+
+  if ((fd = socket (AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) == -1)
+    return;
+
+  memset (& sa, '\0', sizeof (sa));
+  sa . sin_family = AF_INET;
+  sa . sin_addr = addr;
+  sa . sin_port = htons (DISCARD);
+  sendto (fd, NULL, 0, MSG_DONTWAIT, (struct sockaddr *) & sa, sizeof (sa));
+  close (fd);
+}
@@ -0,0 +1,78 @@
+/*
+ * neigh.h - Next hops and their link-layer addresses for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <net/ethernet.h>
+#include <linux/rtnetlink.h>
+
+
+/* A route of the kernel (from its local and main tables) */
+typedef struct
+{
+  struct in_addr dst;             /* the destination                          */
+  uint32_t mask;                  /* its netmask (network byte order)         */
+  uint8_t len;                    /* and its length                           */
+  uint8_t type;                   /* RTN_UNICAST, RTN_LOCAL, ...              */
+  uint8_t table;                  /* RT_TABLE_LOCAL or RT_TABLE_MAIN          */
+  uint8_t asked;                  /* the source address has been asked for    */
+  int ifindex;                    /* the interface (0 for more than one)      */
+  struct in_addr gateway;         /* the next hop (INADDR_ANY when directly connected) */
+  struct in_addr src;             /* source address of the packets (INADDR_ANY when not known) */
+} route_t;
+
+
+/* The routes, the longest prefixes first */
+typedef struct
+{
+  route_t * routes;
+  uint32_t count;
+} routes_t;
+
+
+/* A neighbour whose link-layer address is known */
+typedef struct
+{
+  struct in_addr addr;
+  u_char mac [ETH_ALEN];
+} neigh_t;
+
+
+/* The neighbours on an interface, as read at once from the table of the kernel (sorted by address) */
+typedef struct
+{
+  neigh_t * neighs;
+  uint32_t count;
+} neighs_t;
+
+
+int neigh_routes (routes_t * routes);
+route_t * neigh_match (routes_t * routes, struct in_addr dst);
+void neigh_routes_free (routes_t * routes);
+int neigh_route (struct in_addr dst, int * ifindex, struct in_addr * gateway, struct in_addr * src);
+int neigh_read (neighs_t * neighs, char * iface);
+int neigh_lookup (neighs_t * neighs, struct in_addr addr, u_char * mac);
+void neigh_free (neighs_t * neighs);
+void neigh_solicit (struct in_addr addr);
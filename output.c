@@ -0,0 +1,244 @@
+/*
+ * output.c - Buffered output for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * The lines are rendered without stdio (no locking, no parsing of formats,
+ * no allocation) into a ring buffer, which is written only when flushed
+ * (once per batch of packets) or full, with a single writev() for the
+ * (at most) two pieces the text waiting in the ring is split into.
+ */
+
+
+/* Operating System header file(s) */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Private header file(s) */
+#include "output.h"
+
+
+/* Allocate a ring of (at least) size bytes to buffer the text for fd */
+int out_init (out_t * out, int fd, uint32_t size)
+{
+  memset (out, '\0', sizeof (out_t));
+
+  out -> fd = fd;
+  out -> size = 4096;
+  while (out -> size < size)
+    out -> size <<= 1;
+
+  return (out -> buf = malloc (out -> size)) ? 0 : -1;
+}
+
+
+/* Write all the text buffered and release the ring */
+void out_free (out_t * out)
+{
+  out_flush (out);
+  free (out -> buf);
+  memset (out, '\0', sizeof (out_t));
+}
+
+
+/* Write all the text buffered */
+void out_flush (out_t * out)
+{
+  while (out -> head < out -> tail)
+    {
+      uint32_t from = out -> head & (out -> size - 1);
+      uint32_t to = out -> tail & (out -> size - 1);
+      struct iovec iov [2];
+      int n = 1;
+      ssize_t nwritten;
+
+      /* The text could wrap around the end of the ring */
+      iov [0] . iov_base = out -> buf + from;
+      if (from < to)
+	iov [0] . iov_len = to - from;
+      else
+	{
+	  iov [0] . iov_len = out -> size - from;
+	  iov [1] . iov_base = out -> buf;
+	  iov [1] . iov_len = to;
+	  n = to ? 2 : 1;
+	}
+
+      nwritten = writev (out -> fd, iov, n);
+      out -> writes ++;
+      if (nwritten > 0)
+	out -> head += nwritten;
+      else if (nwritten == -1 && errno != EINTR)
+	{
+	  out -> lost += out -> tail - out -> head;
+	  out -> head = out -> tail;
+	}
+    }
+}
+
+
+/* Add len bytes */
+void out_mem (out_t * out, const char * s, size_t len)
+{
+  uint32_t at;
+  uint32_t n;
+
+  if (out -> tail - out -> head + len > out -> size)
+    out_flush (out);
+
+  /* Too much for the ring */
+  if (len > out -> size)
+    {
+      struct iovec iov = { (void *) s, len };
+      if (writev (out -> fd, & iov, 1) != (ssize_t) len)
+	out -> lost += len;
+      out -> writes ++;
+      return;
+    }
+
+  at = out -> tail & (out -> size - 1);
+  n = len < out -> size - at ? len : out -> size - at;
+  memcpy (out -> buf + at, s, n);
+  memcpy (out -> buf, s + n, len - n);
+  out -> tail += len;
+}
+
+
+/* Add a string */
+void out_str (out_t * out, const char * s)
+{
+  out_mem (out, s, strlen (s));
+}
+
+
+/* Add a character */
+void out_chr (out_t * out, char c)
+{
+  out_mem (out, & c, 1);
+}
+
+
+/* Render an unsigned number with (at least) width digits, return its length */
+static int fmtuint (char * buf, uint64_t n, int width)
+{
+  char digits [20];
+  int len = 0;
+  int i;
+
+  do
+    {
+      digits [len ++] = '0' + n % 10;
+      n /= 10;
+    }
+  while (n);
+  while (len < width)
+    digits [len ++] = '0';
+
+  for (i = 0; i < len; i ++)
+    buf [i] = digits [len - 1 - i];
+
+  return len;
+}
+
+
+/* Add an unsigned number */
+void out_uint (out_t * out, uint64_t n)
+{
+  char buf [20];
+
+  out_mem (out, buf, fmtuint (buf, n, 0));
+}
+
+
+/* Add a signed number */
+void out_int (out_t * out, int64_t n)
+{
+  if (n < 0)
+    {
+      out_chr (out, '-');
+      out_uint (out, - (uint64_t) n);
+    }
+  else
+    out_uint (out, n);
+}
+
+
+/* Add a time given in nanoseconds in milliseconds with three digits of precision (as ping does) */
+void out_ms (out_t * out, int64_t ns)
+{
+  char buf [32];
+  int64_t t = ns < 0 ? 0 : ns / 1000;   /* microseconds */
+  int len = fmtuint (buf, t / 1000, 0);
+
+  /* <= 0.999 ms */
+  if (t < 1000)
+    {
+      buf [len ++] = '.';
+      len += fmtuint (buf + len, t, 3);
+    }
+
+  /* 1.00 - 9.99 ms */
+  else if (t < 10000)
+    {
+      buf [len ++] = '.';
+      len += fmtuint (buf + len, (t % 1000) / 10, 2);
+    }
+
+  /* 10.0 - 99.9 ms */
+  else if (t < 100000)
+    {
+      buf [len ++] = '.';
+      len += fmtuint (buf + len, (t % 1000) / 100, 1);
+    }
+
+  out_mem (out, buf, len);
+}
+
+
+/* Render an internet address in dotted notation, return its length (at most 15) */
+int fmtaddr (char * buf, struct in_addr in)
+{
+  u_char * b = (u_char *) & in . s_addr;
+  int len = 0;
+  int i;
+
+  for (i = 0; i < 4; i ++)
+    {
+      if (i)
+	buf [len ++] = '.';
+      len += fmtuint (buf + len, b [i], 0);
+    }
+  buf [len] = '\0';
+
+  return len;
+}
+
+
+/* Add an internet address in dotted notation */
+void out_addr (out_t * out, struct in_addr in)
+{
+  char buf [16];
+
+  out_mem (out, buf, fmtaddr (buf, in));
+}
@@ -0,0 +1,58 @@
+/*
+ * output.h - Buffered output for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+
+/* A ring buffer of text waiting to be written */
+typedef struct
+{
+  int fd;                         /* where the text goes                      */
+  char * buf;                     /* the ring                                 */
+  uint32_t size;                  /* its size (a power of 2)                  */
+  uint64_t head;                  /* # of bytes written so far                */
+  uint64_t tail;                  /* # of bytes buffered so far               */
+
+  /* Counters */
+  uint64_t writes;                /* # of system calls to write the text      */
+  uint64_t lost;                  /* # of bytes which could not be written    */
+} out_t;
+
+
+int out_init (out_t * out, int fd, uint32_t size);
+void out_free (out_t * out);
+void out_flush (out_t * out);
+
+void out_mem (out_t * out, const char * s, size_t len);
+void out_str (out_t * out, const char * s);
+void out_chr (out_t * out, char c);
+void out_uint (out_t * out, uint64_t n);
+void out_int (out_t * out, int64_t n);
+void out_ms (out_t * out, int64_t ns);
+void out_addr (out_t * out, struct in_addr in);
+
+/* Render an internet address in dotted notation, return its length */
+int fmtaddr (char * buf, struct in_addr in);
@@ -0,0 +1,83 @@
+/*
+ * pool.c - Pool of packet buffers for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * The buffers are allocated (and touched) once at startup, so that getting
+ * and putting back a buffer is just a pop/push on a stack and the most
+ * recently used buffers, likely still in cache, are reused first.
+ */
+
+
+/* Operating System header file(s) */
+#include <stdlib.h>
+#include <string.h>
+
+/* Private header file(s) */
+#include "pool.h"
+
+
+/* Allocate count buffers of (at least) size bytes each */
+int pool_init (pool_t * pool, uint32_t count, uint32_t size)
+{
+  uint32_t i;
+
+  memset (pool, '\0', sizeof (pool_t));
+
+  pool -> size = CACHEALIGN (size);
+  if (posix_memalign ((void **) & pool -> mem, CACHELINE, (size_t) count * pool -> size) ||
+      ! (pool -> free = calloc (count, sizeof (u_char *))))
+    {
+      pool_free (pool);
+      return -1;
+    }
+
+  /* Fault in all the pages right now, not while pinging */
+  memset (pool -> mem, '\0', (size_t) count * pool -> size);
+
+  pool -> count = pool -> avail = count;
+  for (i = 0; i < count; i ++)
+    pool -> free [i] = pool -> mem + (size_t) (count - 1 - i) * pool -> size;
+
+  return 0;
+}
+
+
+/* Release all the buffers */
+void pool_free (pool_t * pool)
+{
+  free (pool -> mem);
+  free (pool -> free);
+  memset (pool, '\0', sizeof (pool_t));
+}
+
+
+/* Get a buffer, NULL if none is available */
+u_char * pool_get (pool_t * pool)
+{
+  return pool -> avail ? pool -> free [-- pool -> avail] : NULL;
+}
+
+
+/* Put back a buffer */
+void pool_put (pool_t * pool, u_char * buf)
+{
+  pool -> free [pool -> avail ++] = buf;
+}
@@ -0,0 +1,48 @@
+/*
+ * pool.h - Pool of packet buffers for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/* Buffers are aligned to (and their size rounded up to a multiple of) a cache line */
+#define CACHELINE       64
+#define CACHEALIGN(n)   (((n) + CACHELINE - 1) & ~(CACHELINE - 1))
+
+
+/* A fixed number of buffers of the same size allocated all at once */
+typedef struct
+{
+  u_char * mem;                   /* all the buffers, one after the other      */
+  uint32_t size;                  /* size of a buffer                          */
+  uint32_t count;                 /* # of buffers                              */
+  uint32_t avail;                 /* # of buffers available                    */
+  u_char ** free;                 /* stack of the buffers available            */
+} pool_t;
+
+
+int pool_init (pool_t * pool, uint32_t count, uint32_t size);
+void pool_free (pool_t * pool);
+u_char * pool_get (pool_t * pool);
+void pool_put (pool_t * pool, u_char * buf);
@@ -0,0 +1,188 @@
+/*
+ * rdns.c - Cache of reverse DNS lookups for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Looking up the name of an address never blocks: the answer is whatever
+ * is in the cache (NULL when nothing is known yet) and, when missing or
+ * expired, a lookup is started with the asynchronous resolver of libevent.
+ * Its answer will be there for the next time.
+ *
+ * An expired name is still returned while it is being looked up again.
+ * Names are kept for the TTL of the answer (within RDNS_MIN_TTL and
+ * RDNS_MAX_TTL), while the lack of a name (or a failed lookup) is kept
+ * for RDNS_NEG_TTL, so that an address is never looked up more than once
+ * in a while, whatever the number of packets coming from it.
+ */
+
+
+/* Operating System header file(s) */
+#include <stdlib.h>
+#include <string.h>
+
+/* Private header file(s) */
+#include "rdns.h"
+
+
+/* Initial # of buckets of the hash table */
+#define RDNS_BUCKETS    256
+
+
+/* Return the monotonic time in seconds */
+static time_t uptime (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, & ts);
+  return ts . tv_sec;
+}
+
+
+/* Return the bucket of an address, the top bits of its multiplicative hash for the current size of the table */
+static uint32_t bucket (rdns_t * rdns, struct in_addr addr)
+{
+  return (uint32_t) (addr . s_addr * 2654435761u) >> (32 - __builtin_ctz (rdns -> nbuckets));
+}
+
+
+/* Double the # of buckets of the hash table, rehashing all the entries */
+static void grow (rdns_t * rdns)
+{
+  rdns_entry_t ** old = rdns -> buckets;
+  uint32_t n = rdns -> nbuckets;
+  rdns_entry_t * e;
+  uint32_t i;
+
+  if (! (rdns -> buckets = calloc (n * 2, sizeof (rdns_entry_t *))))
+    {
+      rdns -> buckets = old;
+      return;
+    }
+  rdns -> nbuckets = n * 2;
+
+  for (i = 0; i < n; i ++)
+    while ((e = old [i]))
+      {
+	uint32_t b = bucket (rdns, e -> addr);
+	old [i] = e -> next;
+	e -> next = rdns -> buckets [b];
+	rdns -> buckets [b] = e;
+      }
+  free (old);
+}
+
+
+/* Callback for the answer to a lookup */
+static void resolved_cb (int result, char type, int count, int ttl, void * addresses, void * arg)
+{
+  rdns_entry_t * e = arg;
+
+  e -> pending = 0;
+  if (result == DNS_ERR_SHUTDOWN || result == DNS_ERR_CANCEL)
+    return;
+
+  if (result == DNS_ERR_NONE && type == DNS_PTR && count > 0)
+    {
+      free (e -> name);
+      e -> name = strdup (* (char **) addresses);
+      e -> expires = uptime () + (ttl < RDNS_MIN_TTL ? RDNS_MIN_TTL : ttl > RDNS_MAX_TTL ? RDNS_MAX_TTL : ttl);
+    }
+  else
+    {
+      /* No such name, otherwise (timeout, server failure, ...) the one known so far is kept */
+      if (result == DNS_ERR_NOTEXIST || result == DNS_ERR_NONE)
+	{
+	  free (e -> name);
+	  e -> name = NULL;
+	}
+      e -> expires = uptime () + RDNS_NEG_TTL;
+    }
+}
+
+
+/* Initialize an empty cache, all the lookups will be made with dns (none if NULL) */
+void rdns_init (rdns_t * rdns, struct evdns_base * dns)
+{
+  memset (rdns, '\0', sizeof (rdns_t));
+
+  rdns -> dns = dns;
+  if ((rdns -> buckets = calloc (RDNS_BUCKETS, sizeof (rdns_entry_t *))))
+    rdns -> nbuckets = RDNS_BUCKETS;
+}
+
+
+/* Release all the entries (after the resolver, which could have lookups in progress, has been freed) */
+void rdns_free (rdns_t * rdns)
+{
+  rdns_entry_t * e;
+  uint32_t i;
+
+  for (i = 0; i < rdns -> nbuckets; i ++)
+    while ((e = rdns -> buckets [i]))
+      {
+	rdns -> buckets [i] = e -> next;
+	free (e -> name);
+	free (e);
+      }
+  free (rdns -> buckets);
+  memset (rdns, '\0', sizeof (rdns_t));
+}
+
+
+/* Return the name of an address as known so far (NULL if none), looking it up when needed */
+char * rdns_name (rdns_t * rdns, struct in_addr addr)
+{
+  rdns_entry_t * e;
+  time_t now;
+
+  if (! rdns -> dns || ! rdns -> nbuckets)
+    return NULL;
+
+  for (e = rdns -> buckets [bucket (rdns, addr)]; e; e = e -> next)
+    if (e -> addr . s_addr == addr . s_addr)
+      break;
+
+  /* First time this address is seen */
+  if (! e)
+    {
+      if (! (e = calloc (1, sizeof (rdns_entry_t))))
+	return NULL;
+      if (rdns -> count >= rdns -> nbuckets)
+	grow (rdns);
+      e -> addr = addr;
+      e -> next = rdns -> buckets [bucket (rdns, addr)];
+      rdns -> buckets [bucket (rdns, addr)] = e;
+      rdns -> count ++;
+    }
+
+  /* Look it up (again) when unknown or expired */
+  now = uptime ();
+  if (! e -> pending && now >= e -> expires)
+    {
+      e -> pending = 1;
+      if (! evdns_base_resolve_reverse (rdns -> dns, & e -> addr, 0, resolved_cb, e))
+	{
+	  e -> pending = 0;
+	  e -> expires = now + RDNS_NEG_TTL;
+	}
+    }
+
+  return e -> name;
+}
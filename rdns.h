@@ -0,0 +1,66 @@
+/*
+ * rdns.h - Cache of reverse DNS lookups for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+
+/* Libevent header file(s) */
+#include "event2/dns.h"
+
+
+/* How long (in seconds) a name is kept, whatever the TTL of the answer */
+#define RDNS_MIN_TTL    60
+#define RDNS_MAX_TTL    (24 * 3600)
+
+/* How long (in seconds) the lack of a name (or a failed lookup) is kept */
+#define RDNS_NEG_TTL    300
+
+
+typedef struct rdns_entry rdns_entry_t;
+
+/* The name of an internet address (if any) and until when it is valid */
+struct rdns_entry
+{
+  rdns_entry_t * next;            /* next entry in the same bucket            */
+  struct in_addr addr;            /* internet address                         */
+  char * name;                    /* its name, NULL if none (or not yet known) */
+  time_t expires;                 /* time (monotonic, in seconds) to look it up again */
+  int pending;                    /* a lookup is in progress                  */
+};
+
+
+/* The cache: a hash table of the addresses looked up */
+typedef struct
+{
+  struct evdns_base * dns;        /* asynchronous resolver, NULL for numeric only */
+  rdns_entry_t ** buckets;        /* hash table                               */
+  uint32_t nbuckets;              /* # of buckets (a power of 2)              */
+  uint32_t count;                 /* # of entries                             */
+} rdns_t;
+
+
+void rdns_init (rdns_t * rdns, struct evdns_base * dns);
+void rdns_free (rdns_t * rdns);
+char * rdns_name (rdns_t * rdns, struct in_addr addr);
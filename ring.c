@@ -0,0 +1,167 @@
+/*
+ * ring.c - Memory-mapped receive ring (AF_PACKET, TPACKET_V3) for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * The kernel copies each packet accepted by the filter of the socket
+ * straight into a ring of blocks mapped in the address space of the
+ * program, packed one after the other, each one preceded by a header
+ * holding its length and the time it has been received.  A block is
+ * handed over to the program when full, or at the latest RING_RETIRE msec
+ * after its first packet, and given back as a whole once all its packets
+ * have been read: no system call and no copy per packet, and the socket
+ * becomes readable only when there is a block to read.
+ *
+ * The socket is a cooked (SOCK_DGRAM) one, so the packets start with
+ * their IP header whatever the interface they have been received from.
+ */
+
+
+/* Operating System header file(s) */
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+/* Private header file(s) */
+#include "ring.h"
+
+
+/* Create the socket and map its ring, no packet is received until started, return -1 on error (errno is set) */
+int ring_open (ring_t * ring, uint32_t blocks, uint32_t size)
+{
+  int version = TPACKET_V3;
+  struct tpacket_req3 req;
+  int err;
+
+  memset (ring, '\0', sizeof (ring_t));
+
+  /* Not bound to any protocol yet, so that nothing is queued before the filter is attached */
+  if ((ring -> fd = socket (AF_PACKET, SOCK_DGRAM, 0)) == -1)
+    return -1;
+
+  memset (& req, '\0', sizeof (req));
+  req . tp_block_size = size;
+  req . tp_block_nr = blocks;
+  req . tp_frame_size = RING_FRAME;
+  req . tp_frame_nr = (uint64_t) size * blocks / RING_FRAME;
+  req . tp_retire_blk_tov = RING_RETIRE;
+
+  if (setsockopt (ring -> fd, SOL_PACKET, PACKET_VERSION, & version, sizeof (version)) == -1 ||
+      setsockopt (ring -> fd, SOL_PACKET, PACKET_RX_RING, & req, sizeof (req)) == -1 ||
+      (ring -> map = mmap (NULL, (size_t) size * blocks, PROT_READ | PROT_WRITE, MAP_SHARED, ring -> fd, 0)) == MAP_FAILED)
+    {
+      err = errno;
+      close (ring -> fd);
+      ring -> map = NULL;
+      errno = err;
+      return -1;
+    }
+
+  ring -> blocks = blocks;
+  ring -> size = size;
+
+  return ring -> fd;
+}
+
+
+/* Start to receive the IP packets (from all the interfaces) */
+int ring_start (ring_t * ring)
+{
+  struct sockaddr_ll sll;
+
+  memset (& sll, '\0', sizeof (sll));
+  sll . sll_family = AF_PACKET;
+  sll . sll_protocol = htons (ETH_P_IP);
+
+  return bind (ring -> fd, (struct sockaddr *) & sll, sizeof (sll));
+}
+
+
+/*
+ * Join a fanout group (an identifier of 16 bits, in the host): each packet
+ * is then queued to only one of the sockets in the group, chosen by mode
+ * (PACKET_FANOUT_*).  The socket must have been started.
+ */
+int ring_fanout (ring_t * ring, uint16_t group, int mode)
+{
+  int arg = group | mode << 16;
+
+  return setsockopt (ring -> fd, SOL_PACKET, PACKET_FANOUT, & arg, sizeof (arg));
+}
+
+
+/* Unmap the ring and close the socket, the packets dropped by the kernel are counted first */
+void ring_close (ring_t * ring)
+{
+  struct tpacket_stats_v3 stats;
+  socklen_t len = sizeof (stats);
+
+  if (getsockopt (ring -> fd, SOL_PACKET, PACKET_STATISTICS, & stats, & len) == 0)
+    ring -> drops += stats . tp_drops;
+
+  munmap (ring -> map, (size_t) ring -> size * ring -> blocks);
+  close (ring -> fd);
+  ring -> map = NULL;
+}
+
+
+/*
+ * Call fn on each packet in the blocks handed over by the kernel, in place,
+ * giving the blocks back once read, up to (at least) budget packets: the
+ * blocks are given back as a whole.  Return the # of packets read.
+ */
+uint32_t ring_drain (ring_t * ring, uint32_t budget, ring_fn * fn)
+{
+  uint32_t done = 0;
+
+  while (done < budget)
+    {
+      struct tpacket_block_desc * block = (struct tpacket_block_desc *) (ring -> map + (size_t) ring -> next * ring -> size);
+      struct tpacket3_hdr * hdr;
+      uint32_t n;
+
+      if (! (__atomic_load_n (& block -> hdr . bh1 . block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+	break;
+
+      hdr = (struct tpacket3_hdr *) ((u_char *) block + block -> hdr . bh1 . offset_to_first_pkt);
+      for (n = 0; n < block -> hdr . bh1 . num_pkts; n ++)
+	{
+	  struct timespec ts = { hdr -> tp_sec, hdr -> tp_nsec };
+
+	  fn ((u_char *) hdr + hdr -> tp_net, hdr -> tp_snaplen, & ts);
+	  hdr = (struct tpacket3_hdr *) ((u_char *) hdr + hdr -> tp_next_offset);
+	}
+
+      done += n;
+      ring -> packets += n;
+      ring -> retired ++;
+
+      /* Give the block back to the kernel */
+      __atomic_store_n (& block -> hdr . bh1 . block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+      ring -> next = (ring -> next + 1) % ring -> blocks;
+    }
+
+  return done;
+}
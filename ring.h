@@ -0,0 +1,61 @@
+/*
+ * ring.h - Memory-mapped receive ring (AF_PACKET, TPACKET_V3) for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+
+/* Geometry of the ring */
+#define RING_BLOCKS     64
+#define RING_BLOCK      (128 * 1024)       /* bytes per block (larger than the largest packet) */
+#define RING_FRAME      2048               /* nominal, the packets are packed in the blocks */
+#define RING_RETIRE     1                  /* msec a block not full is waited for before being handed over */
+
+
+/* Called for each packet in the ring (starting with its IP header, read in place) */
+typedef void ring_fn (u_char * packet, uint32_t len, struct timespec * ts);
+
+
+/* A receive ring shared with the kernel */
+typedef struct
+{
+  int fd;                         /* the packet socket                        */
+  u_char * map;                   /* the blocks, mapped                       */
+  uint32_t blocks;                /* # of blocks                              */
+  uint32_t size;                  /* size of a block                          */
+  uint32_t next;                  /* next block to be read                    */
+
+  /* Counters */
+  uint64_t packets;               /* # of packets read                        */
+  uint64_t retired;               /* # of blocks read and handed back         */
+  uint64_t drops;                 /* # of packets dropped by the kernel (ring full) */
+} ring_t;
+
+
+int ring_open (ring_t * ring, uint32_t blocks, uint32_t size);
+int ring_start (ring_t * ring);
+int ring_fanout (ring_t * ring, uint16_t group, int mode);
+void ring_close (ring_t * ring);
+uint32_t ring_drain (ring_t * ring, uint32_t budget, ring_fn * fn);
@@ -0,0 +1,275 @@
+/*
+ * sketch.c - Mergeable quantile sketches of round-trip times for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * The buckets are fixed (the same for all the sketches) so that merging
+ * costs SKETCH_BUCKETS additions and the memory is bounded whatever the
+ * number of samples: no sample is kept, and a quantile is reported as
+ * the value which is within SKETCH_ALPHA of all those in its bucket.
+ *
+ * The serialized form does not depend on the host (all the integers are
+ * little-endian) and lists only the buckets not empty:
+ *
+ *   magic      4 bytes   SKETCH_MAGIC
+ *   version    1 byte    SKETCH_VERSION
+ *   spare      1 byte
+ *   buckets    2 bytes   SKETCH_BUCKETS
+ *   alpha      4 bytes   SKETCH_PPM
+ *   min        4 bytes   SKETCH_MIN
+ *   from, to, count, sum, min, max   8 bytes each
+ *   n          2 bytes   # of buckets not empty
+ *   n times    the distance from the previous bucket not empty and its counter (varints)
+ */
+
+
+/* Operating System header file(s) */
+#include <string.h>
+#include <math.h>
+
+/* Private header file(s) */
+#include "sketch.h"
+
+
+/* The gamma of the buckets and its logarithm */
+#define GAMMA           ((1 + SKETCH_ALPHA) / (1 - SKETCH_ALPHA))
+#define LOGGAMMA        log1p (2 * SKETCH_ALPHA / (1 - SKETCH_ALPHA))
+
+
+/* Return the bucket of a sample */
+static uint32_t bucket (int64_t ns)
+{
+  double b;
+
+  if (ns <= SKETCH_MIN)
+    return 0;
+
+  b = ceil (log ((double) ns / SKETCH_MIN) / LOGGAMMA);
+
+  return b < SKETCH_BUCKETS ? b : SKETCH_BUCKETS - 1;
+}
+
+
+/* Return the value a bucket stands for, the one within SKETCH_ALPHA of all those in its range */
+static int64_t value (uint32_t b)
+{
+  return SKETCH_MIN * pow (GAMMA, b) * 2 / (1 + GAMMA);
+}
+
+
+/* Start with no samples */
+void sketch_init (sketch_t * sketch)
+{
+  memset (sketch, '\0', sizeof (sketch_t));
+}
+
+
+/* Add a sample */
+void sketch_add (sketch_t * sketch, int64_t ns)
+{
+  if (ns < 0)
+    ns = 0;
+
+  if (! sketch -> count || ns < sketch -> min)
+    sketch -> min = ns;
+  if (! sketch -> count || ns > sketch -> max)
+    sketch -> max = ns;
+
+  sketch -> count ++;
+  sketch -> sum += ns;
+  sketch -> buckets [bucket (ns)] ++;
+}
+
+
+/* Add to a sketch all the samples of another one */
+void sketch_merge (sketch_t * sketch, sketch_t * other)
+{
+  uint32_t b;
+
+  if (! other -> count)
+    return;
+
+  if (! sketch -> count || other -> min < sketch -> min)
+    sketch -> min = other -> min;
+  if (! sketch -> count || other -> max > sketch -> max)
+    sketch -> max = other -> max;
+  if (! sketch -> from || (other -> from && other -> from < sketch -> from))
+    sketch -> from = other -> from;
+  if (other -> to > sketch -> to)
+    sketch -> to = other -> to;
+
+  sketch -> count += other -> count;
+  sketch -> sum += other -> sum;
+  for (b = 0; b < SKETCH_BUCKETS; b ++)
+    sketch -> buckets [b] += other -> buckets [b];
+}
+
+
+/* Return the q-quantile (0 < q <= 1) of the samples, within the smallest and the largest */
+int64_t sketch_quantile (sketch_t * sketch, double q)
+{
+  uint64_t rank = ceil (q * sketch -> count);
+  uint64_t seen = 0;
+  int64_t v = sketch -> max;
+  uint32_t b;
+
+  if (! sketch -> count)
+    return 0;
+
+  for (b = 0; b < SKETCH_BUCKETS; b ++)
+    if ((seen += sketch -> buckets [b]) >= rank)
+      {
+	v = value (b);
+	break;
+      }
+
+  return v < sketch -> min ? sketch -> min : v > sketch -> max ? sketch -> max : v;
+}
+
+
+/* Little-endian integers of n bytes */
+static u_char * put (u_char * p, uint64_t v, int n)
+{
+  while (n --)
+    {
+      * p ++ = v & 0xff;
+      v >>= 8;
+    }
+  return p;
+}
+
+
+static u_char * get (u_char * p, uint64_t * v, int n)
+{
+  int i;
+
+  for (* v = 0, i = 0; i < n; i ++)
+    * v |= (uint64_t) p [i] << (8 * i);
+  return p + n;
+}
+
+
+/* Unsigned integers of 7 bits per byte, the most significant bit set in all the bytes but the last */
+static u_char * putvar (u_char * p, uint64_t v)
+{
+  while (v >= 0x80)
+    {
+      * p ++ = v | 0x80;
+      v >>= 7;
+    }
+  * p ++ = v;
+  return p;
+}
+
+
+static u_char * getvar (u_char * p, u_char * end, uint64_t * v)
+{
+  int shift;
+
+  for (* v = 0, shift = 0; p < end && shift < 64; shift += 7)
+    {
+      * v |= (uint64_t) (* p & 0x7f) << shift;
+      if (! (* p ++ & 0x80))
+	return p;
+    }
+  return NULL;
+}
+
+
+/* Serialize a sketch into buf (at least SKETCH_MAXLEN bytes), return its length */
+size_t sketch_encode (sketch_t * sketch, u_char * buf)
+{
+  u_char * p = buf;
+  uint32_t n = 0;
+  uint32_t last = 0;
+  uint32_t b;
+
+  for (b = 0; b < SKETCH_BUCKETS; b ++)
+    n += sketch -> buckets [b] != 0;
+
+  memcpy (p, SKETCH_MAGIC, 4);
+  p = put (p + 4, SKETCH_VERSION, 1);
+  p = put (p, 0, 1);
+  p = put (p, SKETCH_BUCKETS, 2);
+  p = put (p, SKETCH_PPM, 4);
+  p = put (p, SKETCH_MIN, 4);
+  p = put (p, sketch -> from, 8);
+  p = put (p, sketch -> to, 8);
+  p = put (p, sketch -> count, 8);
+  p = put (p, sketch -> sum, 8);
+  p = put (p, sketch -> min, 8);
+  p = put (p, sketch -> max, 8);
+  p = put (p, n, 2);
+
+  for (b = 0; b < SKETCH_BUCKETS; b ++)
+    if (sketch -> buckets [b])
+      {
+	p = putvar (p, b - last);
+	p = putvar (p, sketch -> buckets [b]);
+	last = b;
+      }
+
+  return p - buf;
+}
+
+
+/*
+ * Read a sketch from the len bytes at buf, return the # of bytes read, -1 when
+ * they do not hold a sketch with the same buckets as ours (it could not be merged)
+ */
+ssize_t sketch_decode (sketch_t * sketch, u_char * buf, size_t len)
+{
+  u_char * p = buf;
+  u_char * end = buf + len;
+  uint64_t v [6];
+  uint64_t n;
+  uint64_t b = 0;
+  uint64_t d;
+  uint64_t c;
+  int i;
+
+  if (len < 66 || memcmp (p, SKETCH_MAGIC, 4) || p [4] != SKETCH_VERSION)
+    return -1;
+
+  p = get (p + 6, & v [0], 2);
+  p = get (p, & v [1], 4);
+  p = get (p, & v [2], 4);
+  if (v [0] != SKETCH_BUCKETS || v [1] != SKETCH_PPM || v [2] != SKETCH_MIN)
+    return -1;
+
+  sketch_init (sketch);
+  for (i = 0; i < 6; i ++)
+    p = get (p, & v [i], 8);
+  sketch -> from = v [0];
+  sketch -> to = v [1];
+  sketch -> count = v [2];
+  sketch -> sum = v [3];
+  sketch -> min = v [4];
+  sketch -> max = v [5];
+
+  for (p = get (p, & n, 2); n; n --)
+    {
+      if (! (p = getvar (p, end, & d)) || ! (p = getvar (p, end, & c)) || (b += d) >= SKETCH_BUCKETS)
+	return -1;
+      sketch -> buckets [b] = c;
+    }
+
+  return p - buf;
+}
@@ -0,0 +1,74 @@
+/*
+ * sketch.h - Mergeable quantile sketches of round-trip times for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+
+/*
+ * The relative error of the quantiles (1%) holds for the samples between
+ * SKETCH_MIN and SKETCH_MIN * gamma^SKETCH_BUCKETS nanoseconds (1 usec to
+ * about 13 minutes), those out of the range are counted in the first
+ * (or the last) bucket.
+ */
+#define SKETCH_PPM      10000              /* alpha in millionths */
+#define SKETCH_ALPHA    (SKETCH_PPM / 1e6)
+#define SKETCH_MIN      1000               /* nsec */
+#define SKETCH_BUCKETS  1024
+
+/* Identification of the serialized form */
+#define SKETCH_MAGIC    "SPSK"
+#define SKETCH_VERSION  1
+
+/* Max size of the serialized form of a sketch */
+#define SKETCH_MAXLEN   (66 + SKETCH_BUCKETS * (2 + 10))
+
+
+/*
+ * A sketch of a series of samples (in nanoseconds).  Bucket i counts the
+ * samples in (SKETCH_MIN * gamma^(i-1), SKETCH_MIN * gamma^i], with
+ * gamma = (1 + SKETCH_ALPHA) / (1 - SKETCH_ALPHA) (DDSketch), so that two
+ * sketches are merged by adding their counters, whatever the samples
+ * (targets, time windows, threads) they have been fed with.
+ */
+typedef struct
+{
+  uint64_t from;                  /* time the samples started (nsec since the Epoch) */
+  uint64_t to;                    /* time they ended                          */
+  uint64_t count;                 /* # of samples                             */
+  uint64_t sum;                   /* their sum                                */
+  int64_t min;                    /* smallest sample                          */
+  int64_t max;                    /* largest sample                           */
+  uint64_t buckets [SKETCH_BUCKETS];
+} sketch_t;
+
+
+void sketch_init (sketch_t * sketch);
+void sketch_add (sketch_t * sketch, int64_t ns);
+void sketch_merge (sketch_t * sketch, sketch_t * other);
+int64_t sketch_quantile (sketch_t * sketch, double q);
+
+size_t sketch_encode (sketch_t * sketch, u_char * buf);
+ssize_t sketch_decode (sketch_t * sketch, u_char * buf, size_t len);
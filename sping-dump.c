@@ -0,0 +1,324 @@
+/*
+ * sping-dump.c - Decoder of the binary logs of 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/* Operating System header file(s) */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Private header file(s) */
+#include "binlog.h"
+#include "sketch.h"
+
+
+/* The file being decoded, mapped in memory */
+static struct
+{
+  binlog_head_t * head;
+  binlog_rec_t * recs;            /* all the records, index records included  */
+  uint64_t count;                 /* # of (complete) records                  */
+  char ** names;                  /* names of the targets, by index           */
+} log;
+
+
+/* Map a file in memory and check its header, return -1 on error */
+static int mapfile (char * progname, char * file)
+{
+  struct stat st;
+  char * name;
+  uint32_t i;
+  int fd;
+
+  if ((fd = open (file, O_RDONLY)) == -1 || fstat (fd, & st) == -1)
+    {
+      printf ("%s: cannot open %s (errno %d - %s)\n", progname, file, errno, strerror (errno));
+      return -1;
+    }
+
+  if (st . st_size < sizeof (binlog_head_t) ||
+      (log . head = mmap (NULL, st . st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+      printf ("%s: cannot map %s\n", progname, file);
+      close (fd);
+      return -1;
+    }
+  close (fd);
+
+  if (memcmp (log . head -> magic, BINLOG_MAGIC, sizeof (log . head -> magic)))
+    {
+      printf ("%s: %s is not a binary log of sping\n", progname, file);
+      return -1;
+    }
+
+  if (log . head -> order != BINLOG_ORDER)
+    {
+      printf ("%s: %s has been written on a host with a different byte order\n", progname, file);
+      return -1;
+    }
+
+  if (log . head -> version != BINLOG_VERSION || log . head -> recsize != sizeof (binlog_rec_t) ||
+      log . head -> data > st . st_size)
+    {
+      printf ("%s: %s has an unsupported format (version %u)\n", progname, file, log . head -> version);
+      return -1;
+    }
+
+  /* A partial record at the end (the writer has been killed) is ignored */
+  log . recs = (binlog_rec_t *) ((char *) log . head + log . head -> data);
+  log . count = (st . st_size - log . head -> data) / sizeof (binlog_rec_t);
+
+  /* The names of the targets follow the header */
+  log . names = calloc (log . head -> ntargets, sizeof (char *));
+  name = (char *) (log . head + 1);
+  for (i = 0; i < log . head -> ntargets; i ++)
+    {
+      if (name >= (char *) log . recs)
+	{
+	  printf ("%s: %s has a corrupted table of targets\n", progname, file);
+	  return -1;
+	}
+      log . names [i] = name;
+      name += strnlen (name, (char *) log . recs - name) + 1;
+    }
+
+  return 0;
+}
+
+
+/* Return the position of the first record of the block received at (or just before) the given time */
+static uint64_t seek (uint64_t from)
+{
+  uint64_t lo = 0;
+  uint64_t hi = (log . count + log . head -> block) / (log . head -> block + 1);
+
+  /* The index records are at fixed positions, the first one of each block */
+  while (hi - lo > 1)
+    {
+      uint64_t mid = (lo + hi) / 2;
+
+      if (log . recs [mid * (log . head -> block + 1)] . sent <= from)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  return lo * (log . head -> block + 1);
+}
+
+
+/* The text of the status of a reply (its flags separated by '+') */
+static char * status (uint8_t s)
+{
+  static char * flags [] = { "badcksum", "baddata", "dup", "late", "reordered", "lost" };
+  static char buf [64];
+  int i;
+
+  if (s == BINLOG_OK)
+    return "ok";
+
+  buf [0] = '\0';
+  for (i = 0; i < sizeof (flags) / sizeof (flags [0]); i ++)
+    if (s & (1 << i))
+      {
+	if (buf [0])
+	  strcat (buf, "+");
+	strcat (buf, flags [i]);
+      }
+
+  return buf;
+}
+
+
+/*
+ * Merge all the sketches in the files written by sping -k (those of the windows
+ * ending before the given time excluded) and print the round-trip times
+ */
+static int sketches (char * progname, char ** files, uint64_t from)
+{
+  static sketch_t total;
+  static sketch_t one;
+  uint32_t merged = 0;
+
+  sketch_init (& total);
+  for (; * files; files ++)
+    {
+      struct stat st;
+      u_char * buf;
+      size_t off;
+      ssize_t len;
+      int fd;
+
+      if ((fd = open (* files, O_RDONLY)) == -1 || fstat (fd, & st) == -1)
+	{
+	  printf ("%s: cannot open %s (errno %d - %s)\n", progname, * files, errno, strerror (errno));
+	  return -1;
+	}
+      if (! st . st_size)
+	{
+	  close (fd);
+	  continue;
+	}
+      if ((buf = mmap (NULL, st . st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+	  printf ("%s: cannot map %s\n", progname, * files);
+	  close (fd);
+	  return -1;
+	}
+      close (fd);
+
+      for (off = 0; off < st . st_size; off += len)
+	{
+	  if ((len = sketch_decode (& one, buf + off, st . st_size - off)) == -1)
+	    {
+	      printf ("%s: %s has a bad sketch at offset %zu\n", progname, * files, off);
+	      break;
+	    }
+	  if (one . to >= from)
+	    {
+	      sketch_merge (& total, & one);
+	      merged ++;
+	    }
+	}
+      munmap (buf, st . st_size);
+    }
+
+  printf ("%u sketches from %lu.%09lu to %lu.%09lu, %lu replies\n", merged,
+	  total . from / 1000000000, total . from % 1000000000, total . to / 1000000000, total . to % 1000000000, total . count);
+  if (total . count)
+    printf ("rtt min/avg/max = %.3f/%.3f/%.3f ms, p50/p90/p99/p99.9 = %.3f/%.3f/%.3f/%.3f ms\n",
+	    total . min / 1e6, (double) total . sum / total . count / 1e6, total . max / 1e6,
+	    sketch_quantile (& total, 0.5) / 1e6, sketch_quantile (& total, 0.9) / 1e6,
+	    sketch_quantile (& total, 0.99) / 1e6, sketch_quantile (& total, 0.999) / 1e6);
+
+  return 0;
+}
+
+
+/* How to use this program */
+static void usage (char * progname)
+{
+  printf ("Usage: %s [-c] [-i] [-T time] file\n", progname);
+  printf ("       %s -k [-T time] file [file ...]\n", progname);
+  printf ("   -c         convert to CSV\n");
+  printf ("   -i         list the index of the file only\n");
+  printf ("   -k         merge the sketches of the round-trip times in the files written by sping -k\n");
+  printf ("   -T time    start from the replies received at time (seconds since the Epoch)\n");
+}
+
+
+/* Decode a binary log written by sping -w, or the sketches written by sping -k */
+int main (int argc, char * argv [])
+{
+  int option;
+  int csv = 0;
+  int index = 0;
+  int merge = 0;
+  uint64_t from = 0;
+  uint64_t i;
+
+  /* Notice the program name */
+  char * progname = strrchr (argv [0], '/');
+  progname = ! progname ? * argv : progname + 1;
+
+  /* Parse command line options */
+  while ((option = getopt (argc, argv, "cikT:h")) != -1)
+    switch (option)
+      {
+      case 'c':
+	csv = 1;
+	break;
+
+      case 'i':
+	index = 1;
+	break;
+
+      case 'k':
+	merge = 1;
+	break;
+
+      case 'T':
+	from = atof (optarg) * 1e9;
+	break;
+
+      default:
+	usage (progname);
+	return option == 'h' ? 0 : 1;
+      }
+
+  if (merge && optind < argc)
+    return sketches (progname, argv + optind, from) == -1 ? 1 : 0;
+
+  if (optind != argc - 1)
+    {
+      usage (progname);
+      return 1;
+    }
+
+  if (mapfile (progname, argv [optind]) == -1)
+    return 1;
+
+  if (csv)
+    printf ("sent_ns,target,name,epoch,seq,ttl,size,rtt_ns,txdelay_ns,status\n");
+  else
+    printf ("# %u targets, %u bytes per request, started at %lu.%09lu, %lu records\n",
+	    log . head -> ntargets, log . head -> pktsize,
+	    log . head -> start / 1000000000, log . head -> start % 1000000000, log . count);
+
+  for (i = from ? seek (from) : 0; i < log . count; i ++)
+    {
+      binlog_rec_t * r = & log . recs [i];
+      char * name = r -> target < log . head -> ntargets ? log . names [r -> target] : "?";
+
+      if (r -> status == BINLOG_INDEX)
+	{
+	  if (index)
+	    printf ("block %u at %lu.%09lu: %ld replies before, record %lu\n",
+		    r -> target, r -> sent / 1000000000, r -> sent % 1000000000, r -> rtt, i);
+	  continue;
+	}
+
+      if (index || r -> sent + r -> rtt < from)
+	continue;
+
+      if (csv)
+	printf ("%lu,%u,%s,%u,%u,%u,%u,%ld,%u,%s\n",
+		r -> sent, r -> target, name, r -> epoch, r -> seq, r -> ttl, r -> size, r -> rtt, r -> txdelay, status (r -> status));
+      else if (r -> status & BINLOG_LOST)
+	printf ("%lu.%09lu no answer from %s for icmp_seq=%u\n",
+		r -> sent / 1000000000, r -> sent % 1000000000, name, r -> seq);
+      else
+	printf ("%lu.%09lu %u bytes from %s: icmp_seq=%u ttl=%u time=%.3f ms%s%s%s%s%s\n",
+		r -> sent / 1000000000, r -> sent % 1000000000,
+		r -> size, name, r -> seq, r -> ttl, r -> rtt / 1e6,
+		r -> status & BINLOG_DUP ? " (DUP!)" : "",
+		r -> status & BINLOG_LATE ? " (LATE!)" : "",
+		r -> status & BINLOG_REORDERED ? " (REORDERED!)" : "",
+		r -> status & BINLOG_BADCKSUM ? " (BAD CHECKSUM!)" : "",
+		r -> status & BINLOG_BADDATA ? " (DIFFERENT PAYLOAD!)" : "");
+    }
+
+  return 0;
+}
@@ -20,20 +20,48 @@
 
 
 /* Operating System header file(s) */
+#define _GNU_SOURCE                /* sendmmsg() and recvmmsg() */
 #include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
 #include <errno.h>
 #include <stddef.h>
 #include <unistd.h>
 #include <string.h>
-#include <netdb.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include <sys/param.h>
 #include <netinet/in.h>
+#include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
 #include <arpa/inet.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/if_packet.h>
 
 /* Libevent header file(s) */
 #include "event2/event.h"
+#include "event2/thread.h"
 struct event;
 
+/* Private header file(s) */
+#include "wheel.h"
+#include "cksum.h"
+#include "pool.h"
+#include "filter.h"
+#include "rdns.h"
+#include "output.h"
+#include "binlog.h"
+#include "stats.h"
+#include "sketch.h"
+#include "ring.h"
+#include "txring.h"
+#include "neigh.h"
+#include "uring.h"
+
 /* Packets definitions */
 
 /* max IP packet size is 65536 while fixed IP header size is 20;
@@ -42,342 +70,3035 @@ struct event;
  */
 #define IPHDR           20
 #define MIN_DATA_SIZE   sizeof (data_t)
-#define DFL_DATA_SIZE   (MIN_DATA_SIZE + 44)         /* calculated as so to be like traditional ping */
+#define DFL_DATA_SIZE   (MIN_DATA_SIZE + 36)         /* calculated as so to be like traditional ping */
 #define MAX_DATA_SIZE   (IP_MAXPACKET - IPHDR - ICMP_MINLEN)
 
-#define DFL_PING_INTERVAL (500 * 1000)
+#define DFL_PING_INTERVAL 500              /* msec */
+#define DFL_TIMEOUT     2000               /* msec */
+#define MIN_RTO         5                  /* msec */
+
+/* Max # of packets transmitted/received at once (see sendmmsg and recvmmsg) */
+#define MAX_BATCH       1024
+
+/* Max # of packets received per wakeup (see recvmmsg) */
+#define DFL_BUDGET      256
+
+/* Room for the ancillary data received with a packet (e.g. the kernel timestamps) */
+#define CTRLLEN         256
+
+/* Room ahead of a packet received through io_uring: its lengths, who it is from and its ancillary data */
+#define RXHDRLEN        (sizeof (struct io_uring_recvmsg_out) + sizeof (struct sockaddr_in) + CTRLLEN)
+
+/* Tags of the operations through io_uring other than the transmissions (tagged with their buffer) */
+#define URING_RECV      0
+#define URING_ERRQUEUE  1
+
+/* # of requests per target whose transmit timestamp is remembered (see -t) */
+#define TXSLOTS         16
+
+/* Max # of names of targets being looked up at the same time */
+#define MAX_LOOKUPS     128
+
+/* # of the last requests per target whose reply is waited for, at least and at most (see -T and -i) */
+#define INFLIGHT        64
+#define MAX_INFLIGHT    65536
+
+/* State of a request in the window of a target */
+#define WAITING         1                  /* for its reply                   */
+#define GIVENUP         2                  /* as lost                         */
+
+/* Max # of threads pinging (see -j) */
+#define MAX_THREADS     64
+
+/* # of records logged by a thread before they are written all together (see -w) */
+#define LOGBATCH        256
+
+/* Max # of next hops through the interface of the transmit ring (see -x) */
+#define MAX_HOPS        256
+
+/* How often (msec) and how many times the link-layer address of a next hop is asked for */
+#define NEIGH_RETRY     100
+#define NEIGH_TRIES     10
+
+/* Size of the buffer of the text output */
+#define OUTBUF          (256 * 1024)
+
+/* Resolution of the scheduler */
+#define TICK            (1000 * 1000)      /* nsec */
 
 
 /* Data added to the ICMP header for the purpose to relate request/response */
 typedef struct
 {
-  uint32_t magic;                 /* magic number         */
-  struct timeval ts;              /* time packet was sent */
+  uint32_t cookie;                /* cookie of the session           */
+  uint32_t target;                /* index in the table of targets   */
+  struct timespec ts;             /* time packet was sent            */
+  uint32_t epoch;                 /* # of times the sequence number wrapped */
+  uint32_t spare;
 } data_t;
 
 
-/* Global variables */
-static uint16_t whoami;           /* process pid                               */
-static int fd;	                  /* raw socket used to ping hosts             */
-static char * hostname;           /* who to ping (as given by user)            */
-static struct sockaddr_in saddr;  /* internet address of who to ping           */
+/*
+ * The head of a request: ICMP header and the data added to relate
+ * request/response, the only part which changes from one request to the next.
+ * The rest of the payload is the same for all the requests of all the targets.
+ */
+typedef struct
+{
+  struct icmphdr icmp;
+  data_t data;
+} head_t;
+
+
+/*
+ * Everything the program knows about a host to ping.
+ *
+ * Targets are kept in a flat table allocated once at startup and their index
+ * in the table (in that of their shard, see shard_t) is carried in the payload
+ * of each request, so that a reply is related to its target in O(1) whatever
+ * the number of hosts being pinged.
+ *
+ * Memory per target is bounded: sizeof (target_t) (280 bytes on 64-bit hosts,
+ * the timers, the template of the requests, the address as printed, the
+ * counters of the requests in flight and the statistics are embedded) plus
+ * the hostname as given by the user, the state of each request in flight and
+ * the time it was sent (winsize * 5 bytes), whatever the size of the requests,
+ * and the histogram of the round-trip times (see stats.c) once it replies.
+ */
+typedef struct
+{
+  char * name;                    /* who to ping (as given by user)            */
+  struct sockaddr_in addr;        /* internet address of who to ping           */
+  u_int8_t once;                  /* banner has been already printed           */
+  u_int8_t resolved;              /* internet address is known                 */
+  uint16_t hop;                   /* next hop through the transmit ring (its index plus one, 0 for none) */
+  uint32_t next;                  /* epoch and sequence number of the next request */
+  uint32_t highest;               /* highest epoch and sequence number replied */
+  uint32_t inflight;              /* # of the last winsize requests still waiting for a reply */
+  uint32_t oldest;                /* epoch and sequence number of the oldest of them, or before */
+  wtimer_t expire;                /* timer to give up the oldest request in flight */
+  uint32_t srtt;                  /* smoothed round-trip time (usec, adaptive timeout only) */
+  uint32_t rttvar;                /* and its variation                         */
+  uint32_t sent;                  /* # of requests transmitted                 */
+  uint32_t recv;                  /* # of replies received                     */
+  uint32_t dups;                  /* # of duplicated replies                   */
+  uint32_t late;                  /* # of replies to requests no longer waited for */
+  uint32_t reordered;             /* # of replies received after a later one   */
+  uint32_t lost;                  /* # of requests given up                    */
+  uint32_t lastlost;              /* epoch and sequence number of the last one */
+  uint32_t bursts;                /* # of runs of consecutive requests lost    */
+  uint32_t burst;                 /* length of the current run                 */
+  uint32_t maxburst;              /* and of the longest one                    */
+  wtimer_t timer;                 /* timer to schedule transmission            */
+  head_t head;                    /* template of the requests (checksum included) */
+  char ip [INET_ADDRSTRLEN];      /* internet address in dotted notation       */
+  stats_t rtts;                   /* statistics of the round-trip times        */
+} target_t;
+
+
+/*
+ * A next hop through the interface of the transmit ring (-x only), and
+ * the link-layer header of the frames to the targets routed through it.
+ */
+typedef struct
+{
+  struct in_addr addr;            /* the next hop                              */
+  struct in_addr src;             /* source address of the packets through it  */
+  struct ether_header eth;        /* link-layer header of the frames to it     */
+  uint8_t known;                  /* its link-layer address is known           */
+  uint8_t tries;                  /* # of times it has been asked for          */
+} hop_t;
+
+
+/*
+ * The shards.  With more than one thread (-j) the table of targets is
+ * partitioned by the hash of their names into contiguous shards, each one
+ * pinged by a thread of its own with its own socket (and echo identifier),
+ * event base, scheduler, packet buffers, resolver and output: all the state
+ * on the way of the packets is thread-local, so the threads share nothing
+ * but the binary log and the sketches of the time windows, merged under a
+ * lock once per batch and once per window.  The replies reach only the
+ * socket of the shard they are for: the kernel steers them by identifier
+ * to an ICMP datagram socket, while a raw socket discards all the others
+ * with its own packet filter (see filter.c).  The main thread only handles
+ * the signals and prints the statistics once all the threads are done.
+ */
+typedef struct
+{
+  target_t * targets;             /* its targets                               */
+  uint32_t first;                 /* index of the first one in the whole table */
+  uint32_t count;                 /* # of its targets                          */
+  uint16_t id;                    /* identifier of its echo requests           */
+  int fd;                         /* its socket                                */
+  ring_t ring;                    /* its receive ring (-M only)                */
+  txring_t txring;                /* its transmit ring (-x only)               */
+  uring_t uring;                  /* its io_uring (-u only)                    */
+  uint64_t rxpackets;             /* # of packets its thread has received      */
+  struct event_base * base;
+  struct event * usr1_evt;        /* to print its statistics on user request   */
+  pthread_t thread;
+} shard_t;
+
+
+/* Global variables (the settings, shared by all the threads) */
+static char * progname;
+static uint32_t cookie;           /* random cookie carried by all the requests of this run */
+static int dgram;                 /* sockets are ICMP datagram (not raw) sockets */
 static uint32_t pktsize;          /* packet size (ICMP plus User Data) to send */
-static struct timeval interval;   /* interval between sending ping packets     */
-static struct event * timer;      /* libevent timer to */
+static u_char * padding;          /* payload following the head of all requests */
+static uint16_t padsum;           /* and its ones complement sum               */
+static int verify;                /* verify checksum and payload of the replies */
+static int errors;                /* report the ICMP errors about our requests */
+static uint32_t interval;         /* interval between sending ping packets     */
+static int openloop;              /* send at fixed rate not waiting for replies */
+static uint32_t timeout;          /* how long the reply to a request is waited for (msec) */
+static uint32_t winsize;          /* # of the last requests per target whose reply is waited for */
+static int adaptive;              /* the timeout of each target depends on its round-trip times */
+static uint32_t batch = 1;        /* max # of packets transmitted at once      */
+static uint32_t vector = 1;       /* max # of packets received at once         */
+static uint32_t budget = DFL_BUDGET;  /* max # of packets received per wakeup  */
+static int stamps;                /* kernel transmit timestamps are requested  */
+static int numeric;               /* no reverse lookups                        */
+static int mapped;                /* the replies are read from a receive ring  */
+static int fanout;                /* the receive rings of the threads are in a fanout group */
+static char * txiface;            /* the requests are sent through a transmit ring on this interface */
+static int ioring;                /* the requests and the replies go through io_uring */
+static char * logfile;            /* binary log of the replies (instead of text) */
+static binlog_t binlog;
+static pthread_mutex_t loglock = PTHREAD_MUTEX_INITIALIZER;
+static shard_t * shards;
+static uint32_t nshards;
+static struct event * done_evt;   /* a thread is done (in the event base of the main thread) */
+
+
+/* Thread-local variables (those of the shard being pinged) */
+static __thread uint16_t whoami;  /* process pid (or kernel assigned identifier) */
+static __thread int fd;	          /* socket used to ping hosts                 */
+static __thread uint64_t badcksums;  /* # of replies with a wrong checksum     */
+static __thread uint64_t baddata; /* # of replies with a corrupted payload     */
+static __thread pool_t pool;      /* packet buffers to transmit and receive    */
+static __thread wheel_t wheel;    /* scheduler of all the timed events         */
+static __thread struct event * tick_evt;  /* to drive it                       */
+static __thread uint64_t wakeup;  /* the tick it is going to be driven at (UINT64_MAX for none) */
+static __thread rdns_t rdns;      /* names of the hosts replying               */
+static __thread out_t output;     /* text output                               */
+static __thread uint32_t * sendticks;  /* winsize per target: the tick each request was sent */
+static __thread uint8_t * states;  /* and its state (WAITING, GIVENUP)         */
+static __thread uint32_t first;   /* index in the whole table of the first target */
+static __thread ring_t * ring;    /* receive ring (-M only)                    */
+static __thread txring_t * txring;  /* transmit ring (-x only)                 */
+static __thread uring_t * uring;  /* io_uring (-u only)                        */
+static __thread struct msghdr rxmsg;  /* the request to receive from the socket through it */
+static __thread int receiving;    /* and it is still going on                  */
+static __thread int watching;     /* its error queue is being watched (-t)     */
+static __thread hop_t hops [MAX_HOPS];  /* the next hops through it            */
+static __thread uint32_t nhops;
+static __thread routes_t routes;  /* the routes of the kernel, read at once    */
+static __thread neighs_t neighs;  /* and its neighbours on the interface       */
+static __thread wtimer_t neightimer;  /* to ask again for the link-layer addresses not known */
+static __thread uint16_t ipid;    /* identification of the IP packets built here */
+
+/* The records logged, waiting to be written to the binary log all together */
+static __thread struct
+{
+  uint32_t count;
+  binlog_rec_t recs [LOGBATCH];
+} logged;
+
+
+/*
+ * The round-trip times of all the targets are also summarized in a sketch
+ * (see sketch.c) per time window, merged at the end of each one into the
+ * sketch of the whole run, and optionally appended in serialized form to
+ * a file, so that they can be merged later with those of other windows,
+ * other runs and other hosts (see sping-dump -k).  Each thread fills a
+ * sketch of its own, merged into the current window when it closes it:
+ * the window is closed when all the threads have done it.
+ */
+static struct
+{
+  uint32_t period;                /* duration of a window (msec), 0 for the whole run */
+  char * file;                    /* where the sketches are appended (if any)  */
+  int fd;
+  pthread_mutex_t lock;
+  uint32_t shards;                /* # of threads still pinging                */
+  uint32_t closed;                /* # of those which closed the current window */
+  sketch_t current;               /* the current window                        */
+  sketch_t total;                 /* the whole run                             */
+} fleet = { 0, NULL, -1, PTHREAD_MUTEX_INITIALIZER };
 
+static __thread sketch_t window;  /* the part of the current window of this thread */
+static __thread wtimer_t windowtimer;  /* to close it                          */
 
-static void push_cb (int unused, const short event, void * arg);
+
+/* Totals of the counters of all the threads */
+static struct
+{
+  pthread_mutex_t lock;
+  uint64_t txpackets;
+  uint64_t txsyscalls;
+  uint64_t batches;
+  uint64_t partial;
+  uint64_t txerrors;
+  uint64_t rxpackets;
+  uint64_t rxsyscalls;
+  uint64_t wakeups;
+  uint64_t blocks;
+  uint64_t drops;
+  uint64_t frames;
+  uint64_t kicks;
+  uint64_t full;
+  uint64_t rejected;
+  uint64_t enters;
+  uint64_t submitted;
+  uint64_t completed;
+  uint64_t nobufs;
+  uint64_t txstamps;
+  uint64_t badcksums;
+  uint64_t baddata;
+} totals = { PTHREAD_MUTEX_INITIALIZER };
 
 
-/* Return the full qualified hostname */
-static char * fqname (struct in_addr in)
+/*
+ * The transmit stage.  When more than one packet at once is requested
+ * the packets due in the same tick are not sent one by one, but queued
+ * in a batch and transmitted all together with a single sendmmsg().
+ */
+static __thread struct
 {
-  struct hostent * h = gethostbyaddr ((char *) & in, sizeof (struct in_addr), AF_INET);
+  uint32_t size;                  /* max # of packets per batch (1 = no batching) */
+  uint32_t queued;                /* # of packets in the batch                 */
+  struct iovec * iov;
+  struct mmsghdr * msgs;
+  target_t ** targets;            /* who each packet is for                    */
 
-  return ! h || ! h -> h_name ? inet_ntoa (in) : h -> h_name;
-}
+  /* Counters */
+  uint64_t packets;               /* # of packets transmitted                  */
+  uint64_t syscalls;              /* # of system calls to transmit them        */
+  uint64_t batches;               /* # of batches flushed                      */
+  uint64_t partial;               /* # of batches not transmitted at once      */
+  uint64_t errors;                /* # of packets not transmitted              */
+} tx = { 1 };
 
 
 /*
- * render time into a string with three digits of precision
- * input is in tens of microseconds
+ * The receive stage.  When more than one packet at once is requested the
+ * socket is drained with recvmmsg() into a preallocated vector of buffers
+ * until there is nothing left to read or the budget of packets per wakeup
+ * is exhausted (so that the timed events are not starved under load).
  */
-static char * fmttime (int t)
+static __thread struct
 {
-  static char buf [10];
+  uint32_t size;                  /* max # of packets per syscall (1 = no batching) */
+  uint32_t budget;                /* max # of packets per wakeup               */
+  struct iovec * iov;
+  struct mmsghdr * msgs;
+  struct sockaddr_in * remotes;   /* who each packet is from                   */
+  u_char * controls;              /* ancillary data of each packet             */
+
+  /* Counters */
+  uint64_t packets;               /* # of packets received                     */
+  uint64_t syscalls;              /* # of system calls to receive them         */
+  uint64_t wakeups;               /* # of times the socket was found readable  */
+} rx = { 1, DFL_BUDGET };
+static __thread target_t * targets;  /* table of hosts to ping (those of the shard in a thread) */
+static __thread uint32_t ntargets;   /* # of entries in the table              */
 
-  /* <= 0.99 ms */
-  if (t < 100)
-    sprintf (buf, "0.%0d", t);
 
-  /* 1.00 - 9.99 ms */
-  else if (t < 1000)
-    sprintf (buf, "%d.%02d", t / 100, t % 100);
+/*
+ * The names of the targets are looked up asynchronously, up to MAX_LOOKUPS
+ * at the same time, and each target starts to be pinged as soon as its
+ * internet address is known, while the others are still being looked up.
+ */
+static __thread struct
+{
+  struct event_base * base;
+  struct evdns_base * dns;        /* asynchronous resolver                     */
+  uint32_t next;                  /* next target to look up                    */
+  uint32_t inflight;              /* # of lookups in progress                  */
+  uint32_t failed;                /* # of names not resolved                   */
+  int busy;                       /* lookups are being started                 */
+} resolver;
 
-  /* 10.0 - 99.9 ms */
-  else if (t < 10000)
-    sprintf (buf, "%d.%d", t / 100, (t % 100) / 10);
 
-  /* >= 100 ms */
-  else
-    sprintf (buf, "%d", t / 100);
+/*
+ * Transmit timestamps.  When requested (-t) the kernel stamps each request
+ * when it actually leaves the host and reports it back on the error queue
+ * of the socket, along with a copy of the packet.  The delay with respect to
+ * the time the request was formatted (the one in its payload) is kept in one
+ * of the TXSLOTS slots of its target (TXSLOTS * 8 bytes per target), indexed
+ * by sequence number, until the reply comes back.
+ */
+typedef struct
+{
+  uint16_t seq;                   /* sequence number of the request            */
+  uint16_t valid;                 /* delay has been reported                   */
+  uint32_t delay;                 /* in-host send delay (in nanoseconds)       */
+} txstamp_t;
 
-  return buf;
+static __thread txstamp_t * txstamps;  /* TXSLOTS per target (when enabled)   */
+static __thread uint64_t ntxstamps;    /* # of transmit timestamps received     */
+
+
+static void push_cb (wtimer_t * timer, void * arg);
+static void lost (target_t * t, uint32_t seq);
+
+
+/* Return the full qualified hostname of a target, the numeric address as long as it is not (yet) known */
+static char * fqname (target_t * t)
+{
+  char * name = rdns_name (& rdns, t -> addr . sin_addr);
+
+  return name ? name : t -> ip;
+}
+
+
+/* Return a time in nanoseconds */
+static int64_t nsec (struct timespec * ts)
+{
+  return (int64_t) ts -> tv_sec * 1000000000 + ts -> tv_nsec;
+}
+
+
+/* Write the records logged by this thread all together, locking the binary log once */
+static void logflush (void)
+{
+  uint32_t i;
+
+  if (! logged . count)
+    return;
+
+  pthread_mutex_lock (& loglock);
+  for (i = 0; i < logged . count; i ++)
+    binlog_write (& binlog, & logged . recs [i]);
+  binlog_flush (& binlog);
+  pthread_mutex_unlock (& loglock);
+  logged . count = 0;
+}
+
+
+/* Log the record of a reply (or of a request given up) */
+static void logrec (binlog_rec_t * rec)
+{
+  logged . recs [logged . count ++] = * rec;
+  if (logged . count == LOGBATCH)
+    logflush ();
 }
 
 
 /*
- * Checksum routine for Internet Protocol family headers (C Version).
- * From ping examples in W. Richard Stevens "Unix Network Programming" book
+ * Update a checksum for a change of len bytes (an even number) from old to new
+ * (RFC 1624: HC' = ~(~HC + ~m + m') for each 16-bit word m changed to m')
  */
-static int mkcksum (u_short * p, int n)
+static uint16_t adjcksum (uint16_t cksum, u_short * old, u_short * new, int len)
 {
-  u_short answer;
-  long sum = 0;
-  u_short odd_byte = 0;
-
-  while (n > 1)
-    {
-      sum += * p ++;
-      n -= 2;
-    }
+  uint32_t sum = (u_short) ~cksum;
 
-  /* mop up an odd byte, if necessary */
-  if (n == 1)
-    {
-      * (u_char *) (& odd_byte) = * (u_char *) p;
-      sum += odd_byte;
-    }
+  for (; len > 1; len -= 2)
+    sum += (u_short) ~ * old ++ + * new ++;
 
   sum = (sum >> 16) + (sum & 0xffff);	/* add high 16 to low 16 */
   sum += (sum >> 16);			/* add carry */
-  answer = ~sum;			/* ones-complement, truncate */
 
-  return answer;
+  return ~sum;
 }
 
 
 /*
- * Format an ICMP_ECHO REQUEST packet
+ * Format the template of the ICMP_ECHO REQUEST packets to a target
  *  - the IP packet will be added on by the kernel
  *  - the ID field is the Unix process ID
  *  - the sequence number is an ascending integer
  *
- *  The first 8 bytes of the data portion are used
- *  The first 8 bytes of the data portion are used
- *  to hold a Unix "timeval" struct in VAX byte-order,
- *  to compute the round-trip time.
+ *  The first bytes of the data portion are used to relate the
+ *  reply to its target and to hold a Unix "timespec" struct
+ *  in host byte-order, to compute the round-trip time.
+ *
+ *  The checksum is computed once here over the whole packet, by adding
+ *  the one of the head to the one of the payload shared by all packets.
  */
-static void fmticmp (u_char * buffer, int size, u_int8_t seq)
+static void mkhead (head_t * head, uint32_t seq, uint32_t index)
 {
-  struct icmp * icmp = (struct icmp *) buffer;
-  data_t * data = (data_t *) (buffer + ICMP_MINLEN);
+  uint32_t sum;
 
-  struct timeval now;
+  memset (head, '\0', sizeof (head_t));
 
   /* The ICMP header (no checksum here until user data has been filled in) */
-  icmp -> icmp_type = ICMP_ECHO;    /* type of message */
-  icmp -> icmp_code = 0;            /* type sub code */
-  icmp -> icmp_id   = whoami;       /* unique application identifier */
-  icmp -> icmp_seq  = htons (seq);  /* message identifier */
+  head -> icmp . type = ICMP_ECHO;          /* type of message */
+  head -> icmp . code = 0;                  /* type sub code */
+  head -> icmp . un . echo . id = whoami;   /* unique application identifier */
+  head -> icmp . un . echo . sequence = htons (seq & 0xffff);  /* message identifier */
 
   /* User data */
-  gettimeofday (& now, NULL);
-  data -> magic = 0xd4c3d2a1;       /* a magic */
-  data -> ts    = now;
+  head -> data . cookie = cookie;           /* who the request is from */
+  head -> data . target = index;            /* who the request is for */
+  head -> data . epoch = seq >> 16;         /* which round of the sequence numbers */
 
   /* Last, compute ICMP checksum */
-  icmp -> icmp_cksum = mkcksum ((u_short *) icmp, size);  /* ones complement checksum of struct */
+  sum = cksum_sum (head, sizeof (head_t)) + padsum;
+  sum = (sum >> 16) + (sum & 0xffff);
+  head -> icmp . checksum = ~(sum + (sum >> 16));
 }
 
 
-/* Attempt to transmit a ping message to a host */
-static void push_cb (int unused, const short event, void * arg)
+/*
+ * Format the next ICMP_ECHO REQUEST packet to a target from its template.
+ *
+ * Only the sequence number and the timestamp change (and the epoch, once
+ * every 65536 requests), so the checksum is updated incrementally for them,
+ * at a cost which does not depend on the size of the packet.
+ */
+static void fmticmp (head_t * head, uint32_t seq)
 {
-  static u_int8_t seq = 1;
-  static int once = 0;
-
-  u_char packet [MAX_DATA_SIZE] = "";
-  int nsent;
+  uint16_t nseq = htons (seq & 0xffff);
+  uint32_t epoch = seq >> 16;
+  struct timespec now;
 
-  /* Format the Echo reply message to send */
-  fmticmp (packet, pktsize, seq ++);
+  head -> icmp . checksum = adjcksum (head -> icmp . checksum, & head -> icmp . un . echo . sequence, & nseq, sizeof (nseq));
+  head -> icmp . un . echo . sequence = nseq;
 
-  /* Transmit the request over the network */
-  nsent = sendto (fd, packet, pktsize, MSG_DONTWAIT, (struct sockaddr *) & saddr, sizeof (struct sockaddr_in));
-  if (nsent != pktsize)
-    printf ("%s error while sending ping [%s]\n", hostname, strerror (errno));
-  else if (! once)
+  if (epoch != head -> data . epoch)
     {
-      printf ("PING %s (%s) %d(%d) bytes of data.\n",
-	      fqname (saddr . sin_addr), inet_ntoa (saddr . sin_addr),
-	      pktsize - ICMP_MINLEN, pktsize + IPHDR);
-      once = 1;
+      head -> icmp . checksum = adjcksum (head -> icmp . checksum, (u_short *) & head -> data . epoch, (u_short *) & epoch, sizeof (epoch));
+      head -> data . epoch = epoch;
     }
+
+  clock_gettime (CLOCK_REALTIME, & now);
+  head -> icmp . checksum = adjcksum (head -> icmp . checksum, (u_short *) & head -> data . ts, (u_short *) & now, sizeof (now));
+  head -> data . ts = now;
+}
+
+
+/* Return the state of a request in the window of a target */
+static uint8_t * state (target_t * t, uint32_t seq)
+{
+  return & states [(size_t) (t - targets) * winsize + (seq & (winsize - 1))];
 }
 
 
-/* Read packet from the wire and attempt to decode and relate ICMP echo reply request/response
+/*
+ * Take the next sequence number of a target for a request.
  *
- * To be cool the packet received must be:
- *  o of enough size (> IPHDR + ICMP_MINLEN)
- *  o of type ICMP_ECHOREPLY
- *  o the one we are looking for (same identifier of all the packets the program is able to send)
+ * The window of the requests in flight slides by one: the state of a request
+ * is kept in its slot of the window (by sequence number) until the slot is
+ * taken again, winsize requests later, so the oldest is given up (if still
+ * waiting) when it falls out.  The window is large enough for all those sent
+ * within the timeout (see main), so that it happens only when given up late.
  */
-static void data_cb (int unused, const short event, void * arg)
+static void nextseq (target_t * t)
 {
-  int nrecv;
-  u_char packet [MAX_DATA_SIZE];
-  struct sockaddr_in remote;              /* responding internet address */
-  socklen_t slen = sizeof (struct sockaddr);
+  uint8_t * s = state (t, t -> next);
 
-  /* Pointer to relevant portions of the packet (IP, ICMP and user data) */
-  struct ip * ip = (struct ip *) packet;
-  struct icmphdr * icmp;
-  data_t * data = (data_t *) (packet + IPHDR + ICMP_MINLEN);
-  int hlen = 0;
+  if (* s == WAITING)
+    {
+      t -> inflight --;
+      lost (t, t -> next - winsize);
+    }
+  * s = 0;
 
-  struct timeval now;
-  struct timeval elapsed;             /* response time */
+  fmticmp (& t -> head, t -> next ++);
+}
 
-  /* Time the packet has been received */
-  gettimeofday (& now, NULL);
 
-  /* Receive data from the network */
-  nrecv = recvfrom (fd, packet, sizeof (packet), MSG_DONTWAIT, (struct sockaddr *) & remote, & slen);
-  if (nrecv < 0)
-    return;
+/* Return how long (in ticks) the reply to a request to a target is waited for */
+static uint32_t rto (target_t * t)
+{
+  uint32_t ms;
 
-  /* Calculate the IP header length */
-  hlen = ip -> ip_hl * 4;
+  if (! adaptive || ! t -> srtt)
+    return timeout;
 
-  /* Check the IP header */
-  if (nrecv < hlen + ICMP_MINLEN || ip -> ip_hl < 5)
+  /* RFC 6298: SRTT + max (G, K * RTTVAR), within MIN_RTO and the timeout given */
+  ms = (t -> srtt + MAX (TICK / 1000, 4 * t -> rttvar) + 999) / 1000;
+
+  return ms < MIN_RTO ? MIN_RTO : ms > timeout ? timeout : ms;
+}
+
+
+/*
+ * Account a ping message transmitted to a host, from now on its reply is waited for.
+ * It is timed by the clock, not by the tick being processed, which is behind it
+ * when the scheduler catches up: the reply could be already waiting to be read.
+ */
+static void pushed (target_t * t, head_t * head)
+{
+  uint32_t seq = head -> data . epoch << 16 | ntohs (head -> icmp . un . echo . sequence);
+
+  if (t -> next - 1 - seq < winsize)
     {
-      printf ("received packet too short for ICMP (%d bytes from %s)\n",
-	      nrecv, inet_ntoa (remote . sin_addr));
-      return;
+      uint64_t now = wheel_clock (& wheel);
+
+      * state (t, seq) = WAITING;
+      t -> inflight ++;
+      sendticks [(size_t) (t - targets) * winsize + (seq & (winsize - 1))] = now;
+      if (! wtimer_armed (& t -> expire))
+	wtimer_arm (& wheel, & t -> expire, now + rto (t));
+    }
+  t -> sent ++;
+  if (! t -> once)
+    {
+      out_str (& output, "PING ");
+      out_str (& output, t -> name);
+      out_str (& output, " (");
+      out_str (& output, t -> ip);
+      out_str (& output, ") ");
+      out_uint (& output, pktsize - ICMP_MINLEN);
+      out_chr (& output, '(');
+      out_uint (& output, pktsize + IPHDR);
+      out_str (& output, ") bytes of data.\n");
+      t -> once = 1;
     }
+}
 
-  /* The ICMP portion */
-  icmp = (struct icmphdr *) (packet + hlen);
 
-  /* Drop unexpected packets */
-  if (icmp -> type != ICMP_ECHOREPLY)
+/* Report a ping message not transmitted to a host */
+static void senderror (target_t * t)
+{
+  out_str (& output, t -> name);
+  out_str (& output, " error while sending ping [");
+  out_str (& output, strerror (errno));
+  out_str (& output, "]\n");
+}
+
+
+/*
+ * A ping message to a host has not been transmitted, so no reply is waited
+ * for: in closed-loop mode the next one is scheduled as if it had been given
+ * up, or the host would be pinged no more.
+ */
+static void unsent (target_t * t)
+{
+  if (! openloop)
+    wtimer_arm (& wheel, & t -> timer, wheel_clock (& wheel) + rto (t));
+}
+
+
+/*
+ * Transmit all the packets queued in the batch.
+ *
+ * sendmmsg() stops at the first packet it fails to transmit, returning the
+ * # of those transmitted (a partial batch), so it is called again for the
+ * remaining.  A packet which fails on its own (e.g. no route to the host) is
+ * skipped, while on a full socket buffer the rest of the batch is dropped.
+ */
+static void flush (void)
+{
+  uint32_t done = 0;
+  uint32_t calls = 0;
+  uint32_t i;
+
+  if (! tx . queued)
     return;
 
-  if (icmp -> un . echo . id != whoami)
+  while (done < tx . queued)
     {
-      printf ("received unexpected packet - id %u != %u (%d bytes from %s)\n",
-	      icmp -> un . echo . id, whoami,
-	      nrecv, inet_ntoa (remote . sin_addr));
-      return;
+      int nsent = sendmmsg (fd, tx . msgs + done, tx . queued - done, MSG_DONTWAIT);
+      calls ++;
+
+      if (nsent > 0)
+	{
+	  for (i = done; i < done + nsent; i ++)
+	    pushed (tx . targets [i], tx . iov [i * 2] . iov_base);
+	  tx . packets += nsent;
+	  done += nsent;
+	}
+      else if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+	{
+	  out_str (& output, "error while sending ");
+	  out_uint (& output, tx . queued - done);
+	  out_str (& output, " ping(s) [");
+	  out_str (& output, strerror (errno));
+	  out_str (& output, "]\n");
+	  tx . errors += tx . queued - done;
+	  for (i = done; i < tx . queued; i ++)
+	    unsent (tx . targets [i]);
+	  break;
+	}
+      else
+	{
+	  senderror (tx . targets [done]);
+	  unsent (tx . targets [done]);
+	  tx . errors ++;
+	  done ++;
+	}
     }
 
-  /* Compute time difference */
-  evutil_timersub (& now, & data -> ts, & elapsed);
+  tx . batches ++;
+  tx . syscalls += calls;
+  if (calls > 1 || done < tx . queued)
+    tx . partial ++;
+
+  for (i = 0; i < tx . queued; i ++)
+    pool_put (& pool, tx . iov [i * 2] . iov_base);
+  tx . queued = 0;
+}
 
-  printf ("%ld bytes from %s (%s): icmp_seq=%d ttl=%d time=%s ms\n",
-	  (long) nrecv - (sizeof (struct icmp) - sizeof (struct icmphdr)),
-	  fqname (remote . sin_addr),
-	  inet_ntoa (remote . sin_addr),
-	  ntohs (icmp -> un . echo . sequence),
-	  ip -> ip_ttl, fmttime (elapsed . tv_usec / 10));
 
-  /* Start the ping timer at given time interval */
-  evtimer_add (timer, & interval);
+/* Queue a packet in the batch, transmitting it when full */
+static void queue (target_t * t)
+{
+  /* The head is built in a buffer of its own, the template could change again before the batch is flushed */
+  u_char * buf = pool_get (& pool);
+
+  nextseq (t);
+  memcpy (buf, & t -> head, sizeof (head_t));
+
+  tx . iov [tx . queued * 2] . iov_base = buf;
+
+  tx . msgs [tx . queued] . msg_hdr . msg_name = & t -> addr;
+  tx . targets [tx . queued] = t;
+
+  if (++ tx . queued == tx . size)
+    flush ();
 }
 
 
-/* Obtain from the OS all that is required to perform the task of pinging hosts */
-static int initialize (char * progname, char * me)
+/*
+ * Build the frame of the next request to a target in the transmit ring,
+ * sent with all the others at the end of the tick, return -1 when the
+ * ring is full.  The IP header is the one the kernel would have added.
+ */
+static int frame (target_t * t)
 {
-  struct protoent * proto;
-  int fd;
-  struct sockaddr_in sa;
-  struct in_addr src;
+  hop_t * hop = & hops [t -> hop - 1];
+  struct ip * ip;
+  int fresh;
+  u_char * buf = txring_frame (txring, & fresh);
+
+  if (! buf)
+    return -1;
+
+  nextseq (t);
+
+  memcpy (buf, & hop -> eth, ETH_HLEN);
+
+  ip = (struct ip *) (buf + ETH_HLEN);
+  ip -> ip_v = 4;
+  ip -> ip_hl = IPHDR / 4;
+  ip -> ip_tos = 0;
+  ip -> ip_len = htons (IPHDR + pktsize);
+  ip -> ip_id = htons (ipid ++);
+  ip -> ip_off = htons (IP_DF);
+  ip -> ip_ttl = IPDEFTTL;
+  ip -> ip_p = IPPROTO_ICMP;
+  ip -> ip_sum = 0;
+  ip -> ip_src = hop -> src;
+  ip -> ip_dst = t -> addr . sin_addr;
+  ip -> ip_sum = cksum (ip, IPHDR);
+
+  /* The payload shared by all the requests is already there, but the first time the slot is used */
+  memcpy (ip + 1, & t -> head, sizeof (head_t));
+  if (fresh)
+    memcpy ((u_char *) (ip + 1) + sizeof (head_t), padding, pktsize - sizeof (head_t));
+
+  txring_send (txring, ETH_HLEN + IPHDR + pktsize);
+  tx . packets ++;
+  pushed (t, & t -> head);
+
+  return 0;
+}
+
+
+/*
+ * Queue the next request to a target for io_uring, submitted with all the
+ * others at the end of the tick, return -1 when no buffer is available.
+ * The request is accounted as transmitted on its completion.
+ */
+static int sendring (target_t * t)
+{
+  struct io_uring_sqe * sqe;
+  u_char * buf;
+
+  if (! pool . avail)
+    return -1;
 
-  /* Check if the ICMP protocol is available on this system */
-  if (! (proto = getprotobyname ("icmp")))
+  if (! (sqe = uring_sqe (uring)))
     {
-      printf ("%s: unsupported protocol icmp\n", progname);
-      return -1;
+      /* The queue is full, those in it are submitted right now */
+      tx . syscalls ++;
+      uring_submit (uring);
+      if (! (sqe = uring_sqe (uring)))
+	return -1;
     }
 
-  /* Create an endpoint for communication using raw socket for ICMP calls */
-  if ((fd = socket (AF_INET, SOCK_RAW, proto -> p_proto)) == -1)
+  /* The payload shared by all the requests is already in the buffer */
+  buf = pool_get (& pool);
+  nextseq (t);
+  memcpy (buf, & t -> head, sizeof (head_t));
+
+  sqe -> opcode = IORING_OP_SEND;
+  sqe -> fd = fd;
+  sqe -> addr = (uintptr_t) buf;
+  sqe -> len = pktsize;
+  sqe -> addr2 = (uintptr_t) & t -> addr;
+  sqe -> addr_len = sizeof (struct sockaddr_in);
+  sqe -> user_data = (uintptr_t) buf;
+
+  return 0;
+}
+
+
+/* Attempt to transmit a ping message to a host */
+static void push_cb (wtimer_t * timer, void * arg)
+{
+  target_t * t = arg;
+
+  /* The packet is made of the head from the template of the target and the payload shared by all */
+  struct iovec iov [2] = { { & t -> head, sizeof (head_t) }, { padding, pktsize - sizeof (head_t) } };
+  struct msghdr msg = { & t -> addr, sizeof (struct sockaddr_in), iov, 2, NULL, 0, 0 };
+  int nsent;
+
+  /* In open-loop mode the next transmission is scheduled at the time interval
+   * whatever the replies (relative to this one, so that the rate does not drift) */
+  if (openloop)
+    wtimer_arm (& wheel, timer, timer -> expires + interval);
+
+  /* Through the transmit ring when its next hop is known (through the socket when full) */
+  if (t -> hop && hops [t -> hop - 1] . known && frame (t) == 0)
+    return;
+
+  /* Through io_uring (through the socket when out of buffers) */
+  if (uring && sendring (t) == 0)
+    return;
+
+  /* Transmit all together with the others due in the same tick */
+  if (tx . size > 1)
     {
-      printf ("%s: can't create raw socket (errno %d - %s)\n", progname, errno, strerror (errno));
-      return -1;
+      queue (t);
+      return;
     }
 
-  if (me)
-    {
-      memset (& sa, 0, sizeof (sa));
-      sa . sin_family = AF_INET;
-      sa . sin_addr = src;
+  /* Format the Echo reply message to send */
+  nextseq (t);
 
-      if (! inet_pton (AF_INET, me, & src) ||
-	  bind (fd, (struct sockaddr *) & sa, sizeof (sa)) == -1)
-	{
-	  printf ("%s: cannot bind source address '%s' (errno %d - %s)\n", progname, me, errno, strerror (errno));
-	  close (fd);
-	  return -1;
-	}
+  /* Transmit the request over the network */
+  nsent = sendmsg (fd, & msg, MSG_DONTWAIT);
+  tx . syscalls ++;
+  if (nsent != pktsize)
+    {
+      senderror (t);
+      unsent (t);
+      tx . errors ++;
+    }
+  else
+    {
+      tx . packets ++;
+      pushed (t, & t -> head);
     }
-
-  return fd;
 }
 
 
-/* Like ping, but with network performances in mind */
-int main (int argc, char * argv [])
+/* Return the tick a request in flight to a target was sent (maybe later than the one being processed) */
+static uint64_t sentat (target_t * t, uint32_t seq)
 {
-  struct event_base * base;
-
-  /* Notice the program name */
-  char * progname = strrchr (argv [0], '/');
-  progname = ! progname ? * argv : progname + 1;
+  uint32_t tick = sendticks [(size_t) (t - targets) * winsize + (seq & (winsize - 1))];
 
-  /* Initialize global variables */
-  whoami = getpid () & 0xffff;
-  pktsize = DFL_DATA_SIZE + ICMP_MINLEN;
+  return wheel . now - (int32_t) (wheel . now - tick);
+}
 
-  interval . tv_sec = 0;
-  interval . tv_usec = DFL_PING_INTERVAL;   /* interval between sending ping packets (in millisec) */
 
-  /* Initialize the libevent */
-  base = event_base_new ();
+/*
+ * Account a request to a target given up as lost, in runs of consecutive ones.
+ * The requests are always given up the oldest first, so a run goes on as long
+ * as the sequence numbers do.
+ */
+static void lost (target_t * t, uint32_t seq)
+{
+  t -> lost ++;
+  if (t -> burst && seq == t -> lastlost + 1)
+    t -> burst ++;
+  else
+    {
+      t -> burst = 1;
+      t -> bursts ++;
+    }
+  if (t -> burst > t -> maxburst)
+    t -> maxburst = t -> burst;
+  t -> lastlost = seq;
 
-  /* Check for at least one mandatory parameter */
-  argv ++;
-  if (! argv || ! * argv)
-    printf ("%s: missing argument\n", progname);
+  if (logfile)
+    {
+      binlog_rec_t rec;
+      struct timespec now;
+
+      /* The time it was sent is known to the tick */
+      clock_gettime (CLOCK_REALTIME, & now);
+      memset (& rec, '\0', sizeof (rec));
+      rec . sent = nsec (& now) - (int64_t) (wheel_clock (& wheel) - sentat (t, seq)) * TICK;
+      rec . target = first + (t - targets);
+      rec . seq = seq & 0xffff;
+      rec . epoch = seq >> 16;
+      rec . status = BINLOG_LOST;
+      logrec (& rec);
+    }
   else
     {
-      /* Handle only the first host name supplied on the command line */
+      out_str (& output, "no answer from ");
+      out_str (& output, t -> name);
+      out_str (& output, " (");
+      out_str (& output, t -> ip);
+      out_str (& output, ") for icmp_seq=");
+      out_uint (& output, seq & 0xffff);
+      out_chr (& output, '\n');
+    }
+}
 
-      struct event * read_evt; /* Used to detect read events */
-      struct hostent * host;
 
-      /* Initialize the application */
-      if ((fd = initialize (progname, NULL)) == -1)
-	return 1;
+/*
+ * Give up the requests to a target whose reply has not been received in time.
+ *
+ * The timer of a target is armed for the oldest request in flight only: the
+ * requests are sent in order, so when it expires the oldest are given up
+ * (moved from WAITING to GIVENUP) and the timer is armed again for the first
+ * one still in time, if any.  A request is never rescheduled, and the oldest
+ * is looked for from where it was the last time, so the cost is O(1) per
+ * request (amortized) whatever the number in flight.
+ */
+static void expire_cb (wtimer_t * timer, void * arg)
+{
+  target_t * t = arg;
+  unsigned given = 0;
 
-      /* Define the callback to send ping packets */
-      timer = evtimer_new (base, push_cb, NULL);
+  while (t -> inflight)
+    {
+      uint8_t * s;
+      uint64_t deadline;
 
-      /* Add the raw file descriptor to the list of those monitored for read events */
-      read_evt = event_new (base, fd, EV_READ | EV_PERSIST, data_cb, NULL);
-      event_add (read_evt, NULL);
+      /* Those out of the window are no longer waited for */
+      if (t -> next - t -> oldest > winsize)
+	t -> oldest = t -> next - winsize;
 
-      /* Setup remote address */
-      memset (& saddr, '\0', sizeof (struct sockaddr_in));
-      saddr . sin_family = AF_INET;
+      s = state (t, t -> oldest);
+      if (* s != WAITING)
+	{
+	  t -> oldest ++;
+	  continue;
+	}
 
-      host = gethostbyname (* argv);
-      if (host)
-	memcpy (& saddr . sin_addr, host -> h_addr_list [0], host -> h_length);
-      else
-	saddr . sin_addr . s_addr = inet_addr (* argv);
-      if (saddr . sin_addr . s_addr == -1)
+      deadline = sentat (t, t -> oldest) + rto (t);
+      if (deadline > wheel . now)
 	{
-	  printf ("%s: unknown host %s\n", progname, * argv);
-	  return 1;
+	  wtimer_arm (& wheel, timer, deadline);
+	  return;
 	}
 
-      /* Save the hostname */
-      hostname = * argv;
+      * s = GIVENUP;
+      t -> inflight --;
+      lost (t, t -> oldest ++);
+      given ++;
+    }
 
-      /* Start the timer to transmit an ICMP request over the network */
-      evtimer_add (timer, & interval);
+  /* A request has been given up and nothing is in flight any longer, in closed-loop mode it is time for the next one */
+  if (! openloop && given)
+    wtimer_arm (& wheel, & t -> timer, wheel . now);
+}
 
-      /* Event dispatching loop */
-      event_base_dispatch (base);
-    }
 
-  /* Terminate the libevent library */
+/* The text of an ICMP error, as ping does */
+static char * icmptext (int type, int code)
+{
+  static char * unreach [] =
+    {
+      "Destination Net Unreachable",
+      "Destination Host Unreachable",
+      "Destination Protocol Unreachable",
+      "Destination Port Unreachable",
+      "Frag needed and DF set",
+      "Source Route Failed",
+    };
+
+  switch (type)
+    {
+    case ICMP_DEST_UNREACH:
+      return code < sizeof (unreach) / sizeof (unreach [0]) ? unreach [code] : "Destination Unreachable";
+    case ICMP_TIME_EXCEEDED:
+      return code == ICMP_EXC_TTL ? "Time to live exceeded" : "Frag reassembly time exceeded";
+    case ICMP_PARAMETERPROB:
+      return "Parameter problem";
+    default:
+      return "Unknown ICMP error";
+    }
+}
+
+
+/*
+ * Report an ICMP error about one of our requests (-e only).
+ *
+ * The error quotes the IP header and (at least) the first 8 bytes of the
+ * datagram which caused it, that is the ICMP header of the echo request,
+ * carrying our identifier and its sequence number.
+ */
+static void icmperror (struct icmphdr * icmp, int len, struct sockaddr_in * from)
+{
+  struct ip * ip = (struct ip *) (icmp + 1);
+  struct icmphdr * echo;
+
+  if (icmp -> type != ICMP_DEST_UNREACH && icmp -> type != ICMP_TIME_EXCEEDED && icmp -> type != ICMP_PARAMETERPROB)
+    return;
+
+  if (len < ICMP_MINLEN + IPHDR + ICMP_MINLEN || ip -> ip_hl < 5 || len < ICMP_MINLEN + ip -> ip_hl * 4 + ICMP_MINLEN)
+    return;
+
+  echo = (struct icmphdr *) ((u_char *) ip + ip -> ip_hl * 4);
+  if (ip -> ip_p != IPPROTO_ICMP || echo -> type != ICMP_ECHO || echo -> un . echo . id != whoami)
+    return;
+
+  out_str (& output, "From ");
+  out_addr (& output, from -> sin_addr);
+  out_str (& output, ": icmp_seq=");
+  out_uint (& output, ntohs (echo -> un . echo . sequence));
+  out_chr (& output, ' ');
+  out_str (& output, icmptext (icmp -> type, icmp -> code));
+  out_str (& output, " (to ");
+  out_addr (& output, ip -> ip_dst);
+  out_str (& output, ")\n");
+}
+
+
+/* Report a packet received which is not a reply to one of our requests */
+static void unexpected (char * what, int nrecv, struct sockaddr_in * from)
+{
+  out_str (& output, "received ");
+  out_str (& output, what);
+  out_str (& output, " (");
+  out_uint (& output, nrecv);
+  out_str (& output, " bytes from ");
+  out_addr (& output, from -> sin_addr);
+  out_str (& output, ")\n");
+}
+
+
+/* Attempt to decode and relate ICMP echo reply request/response
+ *
+ * Packets read from a raw socket start with the IP header, those read from
+ * an ICMP datagram socket directly with the ICMP header (the TTL comes along
+ * as ancillary data).
+ *
+ * To be cool the packet received must be:
+ *  o of enough size (> IPHDR + ICMP_MINLEN + MIN_DATA_SIZE)
+ *  o of type ICMP_ECHOREPLY
+ *  o the one we are looking for (same identifier of all the packets the program is able to send)
+ *  o for one of the targets (a valid index coming back from the host it was sent to)
+ *    and from this run of the program (the cookie of the session)
+ *
+ * On a raw socket the kernel already discarded all the others (see filter.c).
+ */
+static void reply (u_char * packet, int nrecv, struct sockaddr_in * from, struct timespec * now, int ttl)
+{
+  struct sockaddr_in remote = * from;     /* responding internet address */
+
+  /* Pointer to relevant portions of the packet (IP, ICMP and user data) */
+  struct ip * ip = (struct ip *) packet;
+  struct icmphdr * icmp;
+  data_t * data;
+  target_t * t;
+  int hlen = 0;
+  uint16_t seq;
+  uint32_t ago;                       /* # of requests sent after this one */
+  uint8_t status = BINLOG_OK;
+
+  int64_t elapsed;                    /* response time */
+  int64_t delay = -1;                 /* in-host send delay (if known) */
+
+  /* Calculate the IP header length (the packets in the receive ring start with it too) */
+  if (! dgram || mapped)
+    {
+      hlen = ip -> ip_hl * 4;
+      ttl = ip -> ip_ttl;
+    }
+
+  /* Check the IP header */
+  if (nrecv < hlen + ICMP_MINLEN || ((! dgram || mapped) && ip -> ip_hl < 5))
+    {
+      unexpected ("packet too short for ICMP", nrecv, & remote);
+      return;
+    }
+
+  /* The ICMP portion */
+  icmp = (struct icmphdr *) (packet + hlen);
+
+  /* Drop unexpected packets */
+  if (icmp -> type != ICMP_ECHOREPLY)
+    {
+      if (errors)
+	icmperror (icmp, nrecv - hlen, & remote);
+      return;
+    }
+
+  if (icmp -> un . echo . id != whoami)
+    {
+      unexpected ("unexpected packet - bad id", nrecv, & remote);
+      return;
+    }
+
+  /* Relate the reply to its target */
+  data = (data_t *) (packet + hlen + ICMP_MINLEN);
+  if (nrecv < hlen + ICMP_MINLEN + MIN_DATA_SIZE ||
+      data -> cookie != cookie ||
+      data -> target >= ntargets ||
+      targets [data -> target] . addr . sin_addr . s_addr != remote . sin_addr . s_addr)
+    {
+      unexpected ("unexpected packet - no target", nrecv, & remote);
+      return;
+    }
+  t = & targets [data -> target];
+  seq = ntohs (icmp -> un . echo . sequence);
+
+  /* Relate the reply to its request, with the epoch in the payload it is never mistaken for one 65536 requests before.
+   * The sequence numbers taken so far are 1 to next - 1, whether their requests have been transmitted or not */
+  ago = t -> next - 1 - (data -> epoch << 16 | seq);
+  if (ago >= t -> next - 1)
+    {
+      unexpected ("unexpected packet - bad sequence", nrecv, & remote);
+      return;
+    }
+
+  /* Compute time difference */
+  elapsed = nsec (now) - nsec (& data -> ts);
+
+  /* The request has been given up (or is no longer in the window), or its reply has been already received */
+  if (ago >= winsize || * state (t, t -> next - 1 - ago) == GIVENUP)
+    {
+      if (ago < winsize)
+	* state (t, t -> next - 1 - ago) = 0;
+      status |= BINLOG_LATE;
+      t -> late ++;
+    }
+  else if (* state (t, t -> next - 1 - ago) != WAITING)
+    {
+      status |= BINLOG_DUP;
+      t -> dups ++;
+    }
+  else
+    {
+      * state (t, t -> next - 1 - ago) = 0;
+      t -> inflight --;
+      t -> recv ++;
+
+      /* Nothing left to expire, in closed-loop mode the next request is timed by the interval only */
+      if (! openloop && ! t -> inflight)
+	wtimer_cancel (& wheel, & t -> expire);
+
+      /* A reply to a later request has been already received */
+      if ((int32_t) (t -> next - 1 - ago - t -> highest) < 0)
+	{
+	  status |= BINLOG_REORDERED;
+	  t -> reordered ++;
+	}
+      else
+	t -> highest = t -> next - 1 - ago;
+
+      /* RFC 6298: RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R */
+      if (adaptive)
+	{
+	  int32_t r = elapsed > 0 ? elapsed / 1000 : 0;
+
+	  if (! t -> srtt)
+	    {
+	      t -> srtt = r;
+	      t -> rttvar = r / 2;
+	    }
+	  else
+	    {
+	      t -> rttvar = (3 * (int64_t) t -> rttvar + abs ((int32_t) t -> srtt - r)) / 4;
+	      t -> srtt = (7 * (int64_t) t -> srtt + r) / 8;
+	    }
+	}
+
+      stats_add (& t -> rtts, elapsed);
+      sketch_add (& window, elapsed);
+    }
+
+  /* The integrity of the reply: the checksum over the whole ICMP message and the payload as sent */
+  if (verify)
+    {
+      int len = nrecv - hlen - sizeof (head_t);
+
+      if (cksum (icmp, nrecv - hlen))
+	{
+	  status |= BINLOG_BADCKSUM;
+	  badcksums ++;
+	}
+      if (len > pktsize - sizeof (head_t) || memcmp ((u_char *) icmp + sizeof (head_t), padding, len))
+	{
+	  status |= BINLOG_BADDATA;
+	  baddata ++;
+	}
+    }
+
+  /* The in-host send delay, when the request has been stamped on its way out */
+  if (txstamps)
+    {
+      txstamp_t * stamp = & txstamps [(t - targets) * TXSLOTS + seq % TXSLOTS];
+      if (stamp -> valid && stamp -> seq == seq)
+	{
+	  delay = stamp -> delay;
+	  stamp -> valid = 0;
+	}
+    }
+
+  if (logfile)
+    {
+      binlog_rec_t rec;
+
+      memset (& rec, '\0', sizeof (rec));
+      rec . sent = nsec (& data -> ts);
+      rec . rtt = elapsed;
+      rec . target = first + (t - targets);
+      rec . txdelay = delay > 0 ? delay : 0;
+      rec . seq = seq;
+      rec . epoch = data -> epoch;
+      rec . size = nrecv - hlen;
+      rec . ttl = ttl;
+      rec . status = status;
+      logrec (& rec);
+    }
+  else
+    {
+      out_uint (& output, nrecv - hlen);
+      out_str (& output, " bytes from ");
+      out_str (& output, fqname (t));
+      out_str (& output, " (");
+      out_str (& output, t -> ip);
+      out_str (& output, "): icmp_seq=");
+      out_uint (& output, seq);
+      out_str (& output, " ttl=");
+      out_uint (& output, ttl);
+      out_str (& output, " time=");
+      out_ms (& output, elapsed);
+      out_str (& output, " ms");
+      if (status & BINLOG_DUP)
+	out_str (& output, " (DUP!)");
+      if (status & BINLOG_LATE)
+	out_str (& output, " (LATE!)");
+      if (status & BINLOG_REORDERED)
+	out_str (& output, " (REORDERED!)");
+      if (status & BINLOG_BADCKSUM)
+	out_str (& output, " (BAD CHECKSUM!)");
+      if (status & BINLOG_BADDATA)
+	out_str (& output, " (DIFFERENT PAYLOAD!)");
+
+      /* The in-host send delay and the network round-trip time corrected for it */
+      if (delay != -1)
+	{
+	  out_str (& output, " txdelay=");
+	  out_ms (& output, delay);
+	  out_str (& output, " ms net=");
+	  out_ms (& output, elapsed - delay);
+	  out_str (& output, " ms");
+	}
+      out_chr (& output, '\n');
+    }
+
+  /* Start the ping timer of the target at given time interval (closed-loop only, once per request) */
+  if (! openloop && ! (status & (BINLOG_DUP | BINLOG_LATE)))
+    wtimer_arm (& wheel, & t -> timer, wheel . now + interval);
+}
+
+
+/*
+ * Ancillary data received along with a packet:
+ *  o the time it has been received: the one the kernel stamped it with on
+ *    its arrival (SO_TIMESTAMPNS), not affected by any delay in processing it,
+ *    otherwise (when not available) the time the packet has been read
+ *  o its TTL (only on ICMP datagram sockets, see IP_RECVTTL)
+ */
+static void rxinfo (struct msghdr * msg, struct timespec * ts, int * ttl)
+{
+  struct cmsghdr * cmsg;
+
+  for (cmsg = CMSG_FIRSTHDR (msg); cmsg; cmsg = CMSG_NXTHDR (msg, cmsg))
+    if (cmsg -> cmsg_level == SOL_SOCKET && cmsg -> cmsg_type == SCM_TIMESTAMPNS)
+      memcpy (ts, CMSG_DATA (cmsg), sizeof (struct timespec));
+    else if (cmsg -> cmsg_level == IPPROTO_IP && cmsg -> cmsg_type == IP_TTL)
+      memcpy (ttl, CMSG_DATA (cmsg), sizeof (int));
+}
+
+
+/*
+ * Read the transmit timestamps from the error queue of the socket.
+ *
+ * The copy of the request coming along with a timestamp starts with the
+ * link layer header (if any) of the interface it has been sent through, so
+ * it is searched for the IP header of an ICMP echo request of ours.
+ */
+static void txstamped (void)
+{
+  u_char packet [128];
+  u_char control [CTRLLEN];
+  struct iovec iov = { packet, sizeof (packet) };
+  struct msghdr msg = { NULL, 0, & iov, 1, control, sizeof (control), 0 };
+  struct cmsghdr * cmsg;
+  int nrecv;
+
+  while ((nrecv = recvmsg (fd, & msg, MSG_ERRQUEUE | MSG_DONTWAIT)) >= 0)
+    {
+      struct timespec * ktx = NULL;
+      int off;
+
+      for (cmsg = CMSG_FIRSTHDR (& msg); cmsg; cmsg = CMSG_NXTHDR (& msg, cmsg))
+	if (cmsg -> cmsg_level == SOL_SOCKET && cmsg -> cmsg_type == SCM_TIMESTAMPING)
+	  ktx = & ((struct scm_timestamping *) CMSG_DATA (cmsg)) -> ts [0];
+
+      for (off = 0; ktx && off + IPHDR + ICMP_MINLEN + MIN_DATA_SIZE <= nrecv; off += 2)
+	{
+	  struct ip * ip = (struct ip *) (packet + off);
+	  struct icmp * icmp = (struct icmp *) (packet + off + ip -> ip_hl * 4);
+	  data_t * data = (data_t *) ((u_char *) icmp + ICMP_MINLEN);
+
+	  if (ip -> ip_v == 4 && ip -> ip_hl >= 5 && ip -> ip_p == IPPROTO_ICMP &&
+	      off + ip -> ip_hl * 4 + ICMP_MINLEN + MIN_DATA_SIZE <= nrecv &&
+	      icmp -> icmp_type == ICMP_ECHO && icmp -> icmp_id == whoami &&
+	      data -> cookie == cookie && data -> target < ntargets)
+	    {
+	      txstamp_t * stamp = & txstamps [data -> target * TXSLOTS + ntohs (icmp -> icmp_seq) % TXSLOTS];
+
+	      stamp -> seq = ntohs (icmp -> icmp_seq);
+	      stamp -> delay = nsec (ktx) > nsec (& data -> ts) ? nsec (ktx) - nsec (& data -> ts) : 0;
+	      stamp -> valid = 1;
+	      ntxstamps ++;
+	      break;
+	    }
+	}
+
+      msg . msg_controllen = sizeof (control);
+    }
+}
+
+
+/* Have the scheduler driven at a given tick */
+static void wakeat (uint64_t tick)
+{
+  uint64_t now = wheel_clock (& wheel);
+  uint64_t ns = tick > now ? (tick - now) * TICK : 0;
+  struct timeval tv = { ns / 1000000000, ns % 1000000000 / 1000 };
+
+  wakeup = tick;
+  event_add (tick_evt, & tv);
+}
+
+
+/* Have the scheduler driven at the first tick it has something to do at, if any (not once per tick) */
+static void schedule (void)
+{
+  uint64_t next = wheel_next (& wheel);
+
+  wakeup = UINT64_MAX;
+  if (next != UINT64_MAX)
+    wakeat (next);
+}
+
+
+/* A timer could have been armed (out of the scheduler) to expire before the scheduler is going to be driven */
+static void reschedule (void)
+{
+  if (wheel . soonest < wakeup)
+    wakeat (wheel . soonest);
+}
+
+
+/* Read packet from the wire */
+static void data_cb (int unused, const short event, void * arg)
+{
+  int nrecv;
+  u_char * packet = pool_get (& pool);
+  u_char control [CTRLLEN];
+  struct sockaddr_in remote;              /* responding internet address */
+  struct iovec iov = { packet, pool . size };
+  struct msghdr msg = { & remote, sizeof (remote), & iov, 1, control, sizeof (control), 0 };
+
+  struct timespec now;
+  int ttl = 0;
+
+  /* Transmit timestamps first, the replies could be already there */
+  if (txstamps)
+    txstamped ();
+
+  /* Time the packet has been read */
+  clock_gettime (CLOCK_REALTIME, & now);
+
+  /* Receive data from the network */
+  nrecv = recvmsg (fd, & msg, MSG_DONTWAIT);
+  rx . syscalls ++;
+  rx . wakeups ++;
+  if (nrecv >= 0)
+    {
+      rx . packets ++;
+      rxinfo (& msg, & now, & ttl);
+      reply (packet, nrecv, & remote, & now, ttl);
+    }
+
+  pool_put (& pool, packet);
+  out_flush (& output);
+  logflush ();
+  reschedule ();
+}
+
+
+/* Drain packets from the wire, up to the budget per wakeup */
+static void drain_cb (int unused, const short event, void * arg)
+{
+  uint32_t left = rx . budget;
+  struct timespec now;
+  struct timespec ts;
+  int ttl;
+  int nrecv;
+  int i;
+
+  rx . wakeups ++;
+
+  /* Transmit timestamps first, the replies could be already there */
+  if (txstamps)
+    txstamped ();
+
+  while (left)
+    {
+      unsigned want = left < rx . size ? left : rx . size;
+
+      for (i = 0; i < want; i ++)
+	{
+	  rx . msgs [i] . msg_hdr . msg_namelen = sizeof (struct sockaddr_in);
+	  rx . msgs [i] . msg_hdr . msg_controllen = CTRLLEN;
+	}
+
+      /* Time the packets have been read */
+      clock_gettime (CLOCK_REALTIME, & now);
+
+      nrecv = recvmmsg (fd, rx . msgs, want, MSG_DONTWAIT, NULL);
+      rx . syscalls ++;
+      if (nrecv <= 0)
+	break;
+
+      rx . packets += nrecv;
+      for (i = 0; i < nrecv; i ++)
+	{
+	  ts = now;
+	  ttl = 0;
+	  rxinfo (& rx . msgs [i] . msg_hdr, & ts, & ttl);
+	  reply (rx . iov [i] . iov_base, rx . msgs [i] . msg_len, & rx . remotes [i], & ts, ttl);
+	}
+
+      /* Nothing left to read */
+      if (nrecv < want)
+	break;
+      left -= nrecv;
+    }
+
+  out_flush (& output);
+  logflush ();
+  reschedule ();
+}
+
+
+/* Relate a packet in the receive ring to its request, read in place (the IP header tells who it is from) */
+static void ringed (u_char * packet, uint32_t len, struct timespec * ts)
+{
+  struct ip * ip = (struct ip *) packet;
+  struct sockaddr_in remote;
+
+  /* The frame could have been padded (e.g. up to the minimum size on Ethernet) */
+  if (len >= IPHDR && ntohs (ip -> ip_len) < len)
+    len = ntohs (ip -> ip_len);
+
+  memset (& remote, '\0', sizeof (remote));
+  remote . sin_family = AF_INET;
+  remote . sin_addr = ip -> ip_src;
+
+  reply (packet, len, & remote, ts, 0);
+}
+
+
+/* Read the packets in the blocks of the receive ring handed over by the kernel, up to the budget per wakeup */
+static void ring_cb (int unused, const short event, void * arg)
+{
+  rx . wakeups ++;
+
+  /* Transmit timestamps first, the replies could be already there */
+  if (txstamps)
+    txstamped ();
+
+  rx . packets += ring_drain (ring, rx . budget, ringed);
+
+  out_flush (& output);
+  logflush ();
+  reschedule ();
+}
+
+
+/*
+ * Ask io_uring to receive from the socket until told otherwise, a completion
+ * per packet, and to watch its error queue for the transmit timestamps (-t),
+ * a completion each time there is something in it.  What could not be asked
+ * (the submission queue is full) is asked again later.
+ */
+static void arm (void)
+{
+  struct io_uring_sqe * sqe;
+
+  if (! receiving && (sqe = uring_sqe (uring)))
+    {
+      sqe -> opcode = IORING_OP_RECVMSG;
+      sqe -> fd = fd;
+      sqe -> addr = (uintptr_t) & rxmsg;
+      sqe -> ioprio = IORING_RECV_MULTISHOT;
+      sqe -> flags = IOSQE_BUFFER_SELECT;
+      sqe -> buf_group = URING_GROUP;
+      sqe -> user_data = URING_RECV;
+      receiving = 1;
+    }
+
+  if (txstamps && ! watching && (sqe = uring_sqe (uring)))
+    {
+      sqe -> opcode = IORING_OP_POLL_ADD;
+      sqe -> fd = fd;
+      sqe -> poll32_events = POLLERR;
+      sqe -> len = IORING_POLL_ADD_MULTI;
+      sqe -> user_data = URING_ERRQUEUE;
+      watching = 1;
+    }
+}
+
+
+/* Account a request transmitted through io_uring, its buffer is available again */
+static void sent (u_char * buf, int res)
+{
+  head_t * head = (head_t *) buf;
+  target_t * t = & targets [head -> data . target];
+
+  if (res != pktsize)
+    {
+      errno = res < 0 ? - res : EMSGSIZE;
+      senderror (t);
+      unsent (t);
+      tx . errors ++;
+    }
+  else
+    {
+      tx . packets ++;
+      pushed (t, head);
+    }
+
+  pool_put (& pool, buf);
+}
+
+
+/*
+ * Relate a packet received through io_uring to its request, read in place in
+ * the buffer provided, then give the buffer back.  Return 1 for a packet.
+ */
+static int received (struct io_uring_cqe * cqe, struct timespec * now)
+{
+  uint16_t id = cqe -> flags >> IORING_CQE_BUFFER_SHIFT;
+  struct io_uring_recvmsg_out * out;
+  struct msghdr msg;
+  struct timespec ts = * now;
+  u_char * buf;
+  int ttl = 0;
+
+  /* No longer receiving (e.g. all the buffers were in use), asked again once done */
+  if (! (cqe -> flags & IORING_CQE_F_MORE))
+    {
+      receiving = 0;
+      if (cqe -> res == -ENOBUFS)
+	uring -> nobufs ++;
+      else if (cqe -> res < 0)
+	{
+	  out_str (& output, "error while receiving [");
+	  out_str (& output, strerror (- cqe -> res));
+	  out_str (& output, "]\n");
+	}
+    }
+
+  if (cqe -> res < 0 || ! (cqe -> flags & IORING_CQE_F_BUFFER))
+    return 0;
+
+  /* The lengths, who it is from, the ancillary data (in the room asked for) and the packet */
+  buf = uring -> bufs [id];
+  out = (struct io_uring_recvmsg_out *) buf;
+  memset (& msg, '\0', sizeof (msg));
+  msg . msg_control = buf + sizeof (* out) + sizeof (struct sockaddr_in);
+  msg . msg_controllen = out -> controllen;
+  rxinfo (& msg, & ts, & ttl);
+
+  reply (buf + RXHDRLEN, MIN (out -> payloadlen, uring -> bufsize - RXHDRLEN),
+	 (struct sockaddr_in *) (buf + sizeof (* out)), & ts, ttl);
+
+  uring_recycle (uring, id);
+
+  return 1;
+}
+
+
+/* Handle the completions of io_uring, up to the budget of packets received (a wakeup is counted when some are) */
+static void reap (uint32_t budget)
+{
+  struct io_uring_cqe * cqe;
+  struct timespec now;
+  uint32_t n = 0;
+
+  /* Time the packets have been read */
+  clock_gettime (CLOCK_REALTIME, & now);
+
+  while (n < budget && (cqe = uring_cqe (uring)))
+    {
+      if (cqe -> user_data == URING_RECV)
+	n += received (cqe, & now);
+      else if (cqe -> user_data == URING_ERRQUEUE)
+	{
+	  watching = cqe -> flags & IORING_CQE_F_MORE;
+	  txstamped ();
+	}
+      else
+	sent ((u_char *) (uintptr_t) cqe -> user_data, cqe -> res);
+      uring_seen (uring);
+    }
+  rx . packets += n;
+  if (n)
+    rx . wakeups ++;
+
+  if (! mapped)
+    arm ();
+}
+
+
+/* Read the completions of io_uring, up to the budget per wakeup */
+static void uring_cb (int unused, const short event, void * arg)
+{
+  reap (rx . budget);
+
+  out_flush (& output);
+  logflush ();
+  reschedule ();
+}
+
+
+/* Drive the scheduler: fire all the timed events due up to now, slot by slot, until the next ones */
+static void tick_cb (int unused, const short event, void * arg)
+{
+  wheel_advance (& wheel, wheel_clock (& wheel));
+  flush ();
+
+  /* All the frames built in the tick are sent at once */
+  if (txring && txring -> queued)
+    {
+      tx . syscalls ++;
+      if (txring_kick (txring) == -1)
+	{
+	  out_str (& output, "error while sending frames [");
+	  out_str (& output, strerror (errno));
+	  out_str (& output, "]\n");
+	}
+    }
+
+  /* And all the requests queued for io_uring, whose completions are read right away */
+  if (uring)
+    {
+      if (uring -> pending)
+	{
+	  tx . syscalls ++;
+	  if (uring_submit (uring) == -1)
+	    {
+	      out_str (& output, "error while submitting [");
+	      out_str (& output, strerror (errno));
+	      out_str (& output, "]\n");
+	    }
+	}
+      reap (rx . budget);
+    }
+  out_flush (& output);
+  logflush ();
+  schedule ();
+}
+
+
+/* Print the min/avg/max and the percentiles of the round-trip times in a sketch */
+static void fmtsketch (sketch_t * sketch)
+{
+  out_uint (& output, sketch -> count);
+  out_str (& output, " replies, rtt min/avg/max = ");
+  out_ms (& output, sketch -> min);
+  out_chr (& output, '/');
+  out_ms (& output, sketch -> count ? sketch -> sum / sketch -> count : 0);
+  out_chr (& output, '/');
+  out_ms (& output, sketch -> max);
+  out_str (& output, " ms, p50/p90/p99/p99.9 = ");
+  out_ms (& output, sketch_quantile (sketch, 0.5));
+  out_chr (& output, '/');
+  out_ms (& output, sketch_quantile (sketch, 0.9));
+  out_chr (& output, '/');
+  out_ms (& output, sketch_quantile (sketch, 0.99));
+  out_chr (& output, '/');
+  out_ms (& output, sketch_quantile (sketch, 0.999));
+  out_str (& output, " ms");
+}
+
+
+/*
+ * Merge the part of this thread into the current window, the last thread doing it
+ * (or leaving) closes the window: reports it, saves it and merges it into the whole run
+ */
+static void closewindow (int leaving)
+{
+  struct timespec now;
+  u_char buf [SKETCH_MAXLEN];
+
+  pthread_mutex_lock (& fleet . lock);
+  sketch_merge (& fleet . current, & window);
+  sketch_init (& window);
+  if (leaving)
+    fleet . shards --;
+  else
+    fleet . closed ++;
+
+  if (fleet . closed >= fleet . shards)
+    {
+      clock_gettime (CLOCK_REALTIME, & now);
+      fleet . current . to = nsec (& now);
+
+      if (fleet . period)
+	{
+	  out_str (& output, "--- all targets, last ");
+	  out_uint (& output, (fleet . current . to - fleet . current . from + 500000000) / 1000000000);
+	  out_str (& output, " s: ");
+	  fmtsketch (& fleet . current);
+	  out_str (& output, " ---\n");
+	}
+
+      if (fleet . fd != -1 && fleet . current . count &&
+	  write (fleet . fd, buf, sketch_encode (& fleet . current, buf)) == -1)
+	{
+	  out_str (& output, "error while saving the sketch [");
+	  out_str (& output, strerror (errno));
+	  out_str (& output, "]\n");
+	}
+
+      sketch_merge (& fleet . total, & fleet . current);
+      sketch_init (& fleet . current);
+      fleet . current . from = nsec (& now);
+      fleet . closed = 0;
+    }
+  pthread_mutex_unlock (& fleet . lock);
+}
+
+
+/* Close the current window at the end of its period */
+static void window_cb (wtimer_t * timer, void * arg)
+{
+  closewindow (0);
+  wtimer_arm (& wheel, timer, timer -> expires + fleet . period);
+}
+
+
+/* Print the statistics of the targets pinged, like ping does on exit (and those of all of them together) */
+static void summary (int all)
+{
+  uint32_t i;
+
+  for (i = 0; i < ntargets; i ++)
+    {
+      target_t * t = & targets [i];
+
+      if (! t -> sent)
+	continue;
+
+      out_str (& output, "\n--- ");
+      out_str (& output, t -> name);
+      out_str (& output, " ping statistics ---\n");
+      out_uint (& output, t -> sent);
+      out_str (& output, " packets transmitted, ");
+      out_uint (& output, t -> recv);
+      out_str (& output, " received, ");
+      if (t -> dups)
+	{
+	  out_chr (& output, '+');
+	  out_uint (& output, t -> dups);
+	  out_str (& output, " duplicates, ");
+	}
+      if (t -> late)
+	{
+	  out_uint (& output, t -> late);
+	  out_str (& output, " late, ");
+	}
+      if (t -> reordered)
+	{
+	  out_uint (& output, t -> reordered);
+	  out_str (& output, " reordered, ");
+	}
+      out_uint (& output, t -> recv < t -> sent ? (uint64_t) (t -> sent - t -> recv) * 100 / t -> sent : 0);
+      out_str (& output, "% packet loss\n");
+
+      if (t -> lost)
+	{
+	  out_uint (& output, t -> lost);
+	  out_str (& output, " given up after ");
+	  out_uint (& output, rto (t));
+	  out_str (& output, " ms, in ");
+	  out_uint (& output, t -> bursts);
+	  out_str (& output, " bursts (max ");
+	  out_uint (& output, t -> maxburst);
+	  out_str (& output, ", avg ");
+	  out_uint (& output, t -> lost / t -> bursts);
+	  out_chr (& output, '.');
+	  out_uint (& output, t -> lost * 10 / t -> bursts % 10);
+	  out_str (& output, ")\n");
+	}
+
+      if (t -> rtts . count)
+	{
+	  out_str (& output, "rtt min/avg/max/mdev = ");
+	  out_ms (& output, t -> rtts . min);
+	  out_chr (& output, '/');
+	  out_ms (& output, t -> rtts . mean);
+	  out_chr (& output, '/');
+	  out_ms (& output, t -> rtts . max);
+	  out_chr (& output, '/');
+	  out_ms (& output, stats_stddev (& t -> rtts));
+	  out_str (& output, " ms\nrtt p50/p90/p99/p99.9 = ");
+	  out_ms (& output, stats_quantile (& t -> rtts, 0.5));
+	  out_chr (& output, '/');
+	  out_ms (& output, stats_quantile (& t -> rtts, 0.9));
+	  out_chr (& output, '/');
+	  out_ms (& output, stats_quantile (& t -> rtts, 0.99));
+	  out_chr (& output, '/');
+	  out_ms (& output, stats_quantile (& t -> rtts, 0.999));
+	  out_str (& output, " ms\n");
+	}
+    }
+
+  /* All together */
+  if (all && ntargets > 1 && fleet . total . count)
+    {
+      out_str (& output, "\n--- all targets ---\n");
+      fmtsketch (& fleet . total);
+      out_chr (& output, '\n');
+    }
+}
+
+
+/* Print the statistics on user request, going on pinging (those of the shard only in a thread) */
+static void summary_cb (int unused, const short event, void * arg)
+{
+  summary (nshards == 1);
+  out_flush (& output);
+}
+
+
+/* Terminate the event dispatching loop (those of all the threads) */
+static void stop_cb (int unused, const short event, void * arg)
+{
+  uint32_t i;
+
+  for (i = 0; i < nshards; i ++)
+    event_base_loopbreak (shards [i] . base);
+  event_base_loopbreak (arg);
+}
+
+
+/* Ask all the threads to print the statistics of their shards */
+static void usr1_cb (int unused, const short event, void * arg)
+{
+  uint32_t i;
+
+  for (i = 0; i < nshards; i ++)
+    event_active (shards [i] . usr1_evt, 0, 0);
+}
+
+
+/* A thread is done, all the others could be too */
+static void done_cb (int unused, const short event, void * arg)
+{
+  uint32_t left;
+
+  pthread_mutex_lock (& fleet . lock);
+  left = fleet . shards;
+  pthread_mutex_unlock (& fleet . lock);
+
+  if (! left)
+    event_base_loopbreak (arg);
+}
+
+
+/* Allocate the transmit stage for batches of the given size */
+static void mkbatch (uint32_t size)
+{
+  uint32_t i;
+
+  tx . size = size;
+  tx . iov = calloc (size * 2, sizeof (struct iovec));
+  tx . msgs = calloc (size, sizeof (struct mmsghdr));
+  tx . targets = calloc (size, sizeof (target_t *));
+
+  for (i = 0; i < size; i ++)
+    {
+      tx . iov [i * 2] . iov_len = sizeof (head_t);
+      tx . iov [i * 2 + 1] . iov_base = padding;
+      tx . iov [i * 2 + 1] . iov_len = pktsize - sizeof (head_t);
+      tx . msgs [i] . msg_hdr . msg_namelen = sizeof (struct sockaddr_in);
+      tx . msgs [i] . msg_hdr . msg_iov = & tx . iov [i * 2];
+      tx . msgs [i] . msg_hdr . msg_iovlen = 2;
+    }
+}
+
+
+/* Allocate the receive stage for vectors of the given size */
+static void mkvector (uint32_t size)
+{
+  uint32_t i;
+
+  rx . size = size;
+  rx . iov = calloc (size, sizeof (struct iovec));
+  rx . msgs = calloc (size, sizeof (struct mmsghdr));
+  rx . remotes = calloc (size, sizeof (struct sockaddr_in));
+  rx . controls = calloc (size, CTRLLEN);
+
+  for (i = 0; i < size; i ++)
+    {
+      rx . iov [i] . iov_base = pool_get (& pool);
+      rx . iov [i] . iov_len = pool . size;
+      rx . msgs [i] . msg_hdr . msg_name = & rx . remotes [i];
+      rx . msgs [i] . msg_hdr . msg_iov = & rx . iov [i];
+      rx . msgs [i] . msg_hdr . msg_iovlen = 1;
+      rx . msgs [i] . msg_hdr . msg_control = rx . controls + i * CTRLLEN;
+    }
+}
+
+
+/* Print the counters of the transmit and receive stages (of all the threads) */
+static void txstats (void)
+{
+  uint32_t i;
+
+  printf ("--- %lu packets transmitted in %lu syscalls (%.3f syscalls/packet), %lu errors",
+	  totals . txpackets, totals . txsyscalls,
+	  totals . txpackets ? (double) totals . txsyscalls / totals . txpackets : 0.0, totals . txerrors);
+  if (batch > 1 && ! ioring)
+    printf (", %lu batches of max %u packets, %lu partial", totals . batches, batch, totals . partial);
+  printf (" ---\n");
+
+  if (txiface)
+    printf ("--- %lu frames transmitted through the ring of %s in %lu kicks, %lu times full, %lu rejected ---\n",
+	    totals . frames, txiface, totals . kicks, totals . full, totals . rejected);
+
+  if (ioring)
+    printf ("--- %lu operations submitted to io_uring in %lu syscalls, %lu completed, %lu times out of receive buffers ---\n",
+	    totals . submitted, totals . enters, totals . completed, totals . nobufs);
+
+  if (stamps)
+    printf ("--- %lu kernel transmit timestamps ---\n", totals . txstamps);
+
+  if (verify)
+    printf ("--- %lu replies with a wrong checksum, %lu with a corrupted payload ---\n", totals . badcksums, totals . baddata);
+
+  if (mapped)
+    printf ("--- %lu packets received in %lu blocks of the ring over %lu wakeups, %lu dropped",
+	    totals . rxpackets, totals . blocks, totals . wakeups, totals . drops);
+  else if (ioring)
+    printf ("--- %lu packets received through io_uring over %lu wakeups", totals . rxpackets, totals . wakeups);
+  else
+    printf ("--- %lu packets received in %lu syscalls (%.3f syscalls/packet) over %lu wakeups",
+	    totals . rxpackets, totals . rxsyscalls,
+	    totals . rxpackets ? (double) totals . rxsyscalls / totals . rxpackets : 0.0, totals . wakeups);
+  if (nshards > 1)
+    printf (" by %u threads", nshards);
+  printf (" ---\n");
+
+  /* The balance of the threads */
+  if (nshards > 1)
+    {
+      uint64_t max = 0;
+
+      printf ("--- packets received per thread:");
+      for (i = 0; i < nshards; i ++)
+	{
+	  printf (" %lu", shards [i] . rxpackets);
+	  max = MAX (max, shards [i] . rxpackets);
+	}
+      printf (" (max/mean %.3f) ---\n", totals . rxpackets ? (double) max * nshards / totals . rxpackets : 0.0);
+    }
+
+  if (logfile)
+    printf ("--- %lu replies logged to %s ---\n", binlog . records, logfile);
+}
+
+
+/* Fill in the payload shared by all the requests (an incrementing pattern, like ping) */
+static void mkpadding (void)
+{
+  uint32_t len = pktsize - sizeof (head_t);
+  uint32_t i;
+
+  if (posix_memalign ((void **) & padding, CACHELINE, CACHEALIGN (len + 1)))
+    {
+      printf ("out of memory while allocating the payload\n");
+      exit (1);
+    }
+  for (i = 0; i < len; i ++)
+    padding [i] = i & 0xff;
+
+  padsum = cksum_sum (padding, len);
+}
+
+
+/* Ask the kernel to stamp the requests when they actually leave the host */
+static int mktxstamps (char * progname, int fd)
+{
+  int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+  if (setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPING, & flags, sizeof (flags)) == -1)
+    {
+      printf ("%s: kernel transmit timestamps not available (errno %d - %s)\n", progname, errno, strerror (errno));
+      return -1;
+    }
+
+  return 0;
+}
+
+
+/*
+ * Obtain from the OS all that is required to perform the task of pinging hosts
+ *
+ * The unprivileged ICMP datagram socket (the so called ping socket, see
+ * net.ipv4.ping_group_range) is preferred: the kernel assigns the identifier
+ * of the echo requests (the local port of the socket) and delivers to it only
+ * the replies to them, while a raw socket receives a copy of every ICMP packet
+ * to the host, which must be then discarded here.  When not available (or
+ * not wanted) it falls back to a raw socket.  The identifier is returned in
+ * id: the one given is used on a raw socket, the kernel assigns its own
+ * to an ICMP datagram socket.
+ */
+static int initialize (char * progname, char * me, int raw, uint16_t * id)
+{
+  int fd;
+  struct sockaddr_in sa;
+  socklen_t slen = sizeof (sa);
+  int on = 1;
+
+  memset (& sa, 0, sizeof (sa));
+  sa . sin_family = AF_INET;
+  if (me && ! inet_pton (AF_INET, me, & sa . sin_addr))
+    {
+      printf ("%s: bad source address '%s'\n", progname, me);
+      return -1;
+    }
+
+  /* Create an endpoint for communication using an ICMP datagram socket, the identifier is the port it is bound to */
+  if (! raw && (fd = socket (AF_INET, SOCK_DGRAM, IPPROTO_ICMP)) != -1)
+    {
+      if (bind (fd, (struct sockaddr *) & sa, sizeof (sa)) == -1 ||
+	  getsockname (fd, (struct sockaddr *) & sa, & slen) == -1)
+	{
+	  printf ("%s: cannot bind ICMP datagram socket (errno %d - %s)\n", progname, errno, strerror (errno));
+	  close (fd);
+	  return -1;
+	}
+      * id = sa . sin_port;
+      dgram = 1;
+
+      /* The IP header is not received, so ask for its TTL */
+      setsockopt (fd, IPPROTO_IP, IP_RECVTTL, & on, sizeof (on));
+    }
+  else
+    {
+      /* Create an endpoint for communication using raw socket for ICMP calls */
+      if ((fd = socket (AF_INET, SOCK_RAW, IPPROTO_ICMP)) == -1)
+	{
+	  printf ("%s: can't create raw socket (errno %d - %s)\n", progname, errno, strerror (errno));
+	  return -1;
+	}
+
+      if (me && bind (fd, (struct sockaddr *) & sa, sizeof (sa)) == -1)
+	{
+	  printf ("%s: cannot bind source address '%s' (errno %d - %s)\n", progname, me, errno, strerror (errno));
+	  close (fd);
+	  return -1;
+	}
+
+      /* Let the kernel discard all the ICMP packets which are not for us */
+      if (attach_filter (fd, id, 1, cookie, errors) == -1)
+	printf ("%s: cannot attach packet filter, filtering in user space (errno %d - %s)\n",
+		progname, errno, strerror (errno));
+    }
+
+  /* Ask the kernel to timestamp (with nanosecond resolution) the packets on their arrival */
+  if (setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPNS, & on, sizeof (on)) == -1)
+    printf ("%s: kernel timestamps not available, falling back to user space (errno %d - %s)\n",
+	    progname, errno, strerror (errno));
+
+  return fd;
+}
+
+
+/*
+ * Read the replies to the requests of a shard from a receive ring (see ring.c)
+ * instead of its socket, which is then used only to transmit.  The filter of
+ * the ring accepts only the replies for the shard (and the ICMP errors about
+ * its requests, with -e), as the one of a raw socket does.
+ *
+ * Otherwise the kernel hands a copy of each IP packet to the ring of every
+ * thread, which runs its filter on it.  With -F the rings join a fanout
+ * group, the one of the pid, steering each packet to the only ring it could
+ * be for by the identifier it carries (see filter.c), so the packets are
+ * filtered once and the threads share the work of the kernel too.
+ */
+static int mkring (char * progname, shard_t * s)
+{
+  if (ring_open (& s -> ring, RING_BLOCKS, RING_BLOCK) == -1)
+    {
+      printf ("%s: cannot create the receive ring (errno %d - %s)\n", progname, errno, strerror (errno));
+      return -1;
+    }
+
+  if (attach_packet_filter (s -> ring . fd, & s -> id, 1, cookie, errors) == -1 ||
+      ring_start (& s -> ring) == -1)
+    {
+      printf ("%s: cannot start the receive ring (errno %d - %s)\n", progname, errno, strerror (errno));
+      return -1;
+    }
+
+  /* The group takes the program once all the rings have joined it, in the order of the shards */
+  if (fanout && nshards > 1)
+    {
+      uint16_t ids [MAX_THREADS];
+      uint32_t i;
+
+      if (ring_fanout (& s -> ring, getpid () & 0xffff, PACKET_FANOUT_CBPF) == -1)
+	{
+	  printf ("%s: cannot join the fanout group (errno %d - %s)\n", progname, errno, strerror (errno));
+	  return -1;
+	}
+
+      if (s == & shards [nshards - 1])
+	{
+	  for (i = 0; i < nshards; i ++)
+	    ids [i] = shards [i] . id;
+	  if (attach_fanout_filter (s -> ring . fd, ids, nshards, errors) == -1)
+	    {
+	      printf ("%s: cannot attach the program of the fanout group (errno %d - %s)\n", progname, errno, strerror (errno));
+	      return -1;
+	    }
+	}
+    }
+
+  /* Nothing to read from the socket any longer */
+  if (attach_drop_filter (s -> fd) == -1)
+    printf ("%s: cannot attach packet filter to the socket (errno %d - %s)\n", progname, errno, strerror (errno));
+
+  return 0;
+}
+
+
+/*
+ * Send the requests of a shard through a transmit ring (see txring.c) on an
+ * interface, the frames built here from the link-layer header up (those to
+ * the targets routed through other interfaces are sent through the socket)
+ */
+static int mktxring (char * progname, shard_t * s)
+{
+  if (txring_open (& s -> txring, txiface, ETH_HLEN + IPHDR + pktsize) == -1)
+    {
+      printf ("%s: cannot create the transmit ring on %s (errno %d - %s)\n", progname, txiface, errno, strerror (errno));
+      return -1;
+    }
+
+  if (IPHDR + pktsize > s -> txring . mtu)
+    {
+      printf ("%s: packet size %u too large for the MTU of %s (%u)\n", progname, IPHDR + pktsize, txiface, s -> txring . mtu);
+      return -1;
+    }
+
+  return 0;
+}
+
+
+/*
+ * Send the requests of a shard and receive the replies through io_uring (see
+ * uring.c), in buffers of its pool: the requests are submitted all together
+ * once per tick, and the replies are received into buffers provided to the
+ * kernel once for all.  Created by the thread of the shard, the only one
+ * allowed to submit.
+ */
+static int mkuring (char * progname, shard_t * s)
+{
+  u_char * bufs [URING_BUFS];
+  uint32_t i;
+
+  if (uring_open (& s -> uring, URING_ENTRIES) == -1)
+    {
+      printf ("%s: cannot create the io_uring instance (errno %d - %s)\n", progname, errno, strerror (errno));
+      return -1;
+    }
+  uring = & s -> uring;
+
+  /* The buffers to receive into (unless the replies are read from the receive ring) */
+  if (! mapped)
+    {
+      for (i = 0; i < URING_BUFS; i ++)
+	bufs [i] = pool_get (& pool);
+      if (uring_provide (uring, bufs, URING_BUFS, pool . size) == -1)
+	{
+	  printf ("%s: cannot provide the buffers to receive into (errno %d - %s)\n", progname, errno, strerror (errno));
+	  return -1;
+	}
+
+      rxmsg . msg_namelen = sizeof (struct sockaddr_in);
+      rxmsg . msg_controllen = CTRLLEN;
+      arm ();
+      uring_submit (uring);
+    }
+
+  /* The others are to transmit, the payload shared by all the requests is written once */
+  for (i = 0; i < pool . avail; i ++)
+    memcpy (pool . free [i] + sizeof (head_t), padding, pktsize - sizeof (head_t));
+
+  return 0;
+}
+
+
+/* Add a host to the table of targets, its name will be looked up later (when not a numeric address) */
+static int addtarget (char * progname, char * name)
+{
+  static uint32_t slots = 0;
+  target_t * t;
+
+  /* Grow the table when needed */
+  if (ntargets == slots)
+    {
+      slots = slots ? slots * 2 : 64;
+      if (! (targets = realloc (targets, slots * sizeof (target_t))))
+	{
+	  printf ("%s: out of memory while adding target %s\n", progname, name);
+	  exit (1);
+	}
+    }
+
+  t = & targets [ntargets];
+  memset (t, '\0', sizeof (target_t));
+
+  /* Setup remote address */
+  t -> addr . sin_family = AF_INET;
+  t -> resolved = inet_pton (AF_INET, name, & t -> addr . sin_addr) == 1;
+
+  /* Save the hostname */
+  t -> name = name;
+  t -> next = 1;
+  ntargets ++;
+
+  return 0;
+}
+
+
+/* Add the hosts listed in a file (one per line, '#' starts a comment, '-' is stdin) */
+static int addtargets (char * progname, char * file)
+{
+  FILE * fp = strcmp (file, "-") ? fopen (file, "r") : stdin;
+  char line [1024];
+  char * name;
+
+  if (! fp)
+    {
+      printf ("%s: cannot open %s (errno %d - %s)\n", progname, file, errno, strerror (errno));
+      return -1;
+    }
+
+  while (fgets (line, sizeof (line), fp))
+    {
+      if ((name = strchr (line, '#')))
+	* name = '\0';
+      if ((name = strtok (line, " \t\r\n")))
+	addtarget (progname, strdup (name));
+    }
+
+  if (fp != stdin)
+    fclose (fp);
+
+  return 0;
+}
+
+
+/*
+ * Partition the table of targets into shards by the hash of their names
+ * (FNV-1a), the targets of a shard are moved next to each other in the
+ * table (in the order they were given), return the # of shards not empty
+ */
+static uint32_t partition (char * progname, uint32_t n)
+{
+  target_t * table = malloc (ntargets * sizeof (target_t));
+  uint32_t * which = malloc (ntargets * sizeof (uint32_t));
+  uint32_t count [MAX_THREADS] = { 0 };
+  uint32_t shard [MAX_THREADS];
+  uint32_t off = 0;
+  uint32_t i;
+  uint32_t j;
+
+  if (! table || ! which || ! (shards = calloc (n, sizeof (shard_t))))
+    {
+      printf ("%s: out of memory while partitioning the targets\n", progname);
+      exit (1);
+    }
+
+  for (i = 0; i < ntargets; i ++)
+    {
+      uint32_t hash = 2166136261U;
+      u_char * c;
+
+      for (c = (u_char *) targets [i] . name; * c; c ++)
+	hash = (hash ^ * c) * 16777619;
+      which [i] = hash % n;
+      count [which [i]] ++;
+    }
+
+  /* The empty ones are dropped */
+  for (i = 0, j = 0; i < n; i ++)
+    if (count [i])
+      {
+	shards [j] . first = off;
+	off += count [i];
+	shard [i] = j ++;
+      }
+
+  for (i = 0; i < ntargets; i ++)
+    {
+      shard_t * s = & shards [shard [which [i]]];
+
+      table [s -> first + s -> count ++] = targets [i];
+    }
+
+  free (targets);
+  free (which);
+  targets = table;
+
+  return j;
+}
+
+
+/*
+ * Return the next hop of a target through the interface of the transmit ring
+ * (its index in the table plus one), 0 when the target is routed through
+ * another interface (it is pinged through the socket then).
+ *
+ * The route is matched against those read at startup, with no system call:
+ * only its source address, when not given, is asked to the kernel, for the
+ * first target through it.
+ */
+static uint16_t nexthop (target_t * t)
+{
+  route_t * route = neigh_match (& routes, t -> addr . sin_addr);
+  struct in_addr gateway;
+  int ifindex;
+  hop_t * hop;
+  uint32_t i;
+
+  if (! route || route -> type != RTN_UNICAST || route -> ifindex != txring -> ifindex)
+    return 0;
+
+  if (route -> src . s_addr == INADDR_ANY && ! route -> asked)
+    {
+      route -> asked = 1;
+      if (neigh_route (t -> addr . sin_addr, & ifindex, & gateway, & route -> src) == -1 || ifindex != txring -> ifindex)
+	route -> src . s_addr = INADDR_ANY;
+    }
+  if (route -> src . s_addr == INADDR_ANY)
+    return 0;
+
+  gateway = route -> gateway . s_addr != INADDR_ANY ? route -> gateway : t -> addr . sin_addr;
+
+  for (i = 0; i < nhops; i ++)
+    if (hops [i] . addr . s_addr == gateway . s_addr)
+      return i + 1;
+
+  if (nhops == MAX_HOPS)
+    return 0;
+
+  hop = & hops [nhops ++];
+  memset (hop, '\0', sizeof (hop_t));
+  hop -> addr = gateway;
+  hop -> src = route -> src;
+  memcpy (hop -> eth . ether_shost, txring -> mac, ETH_ALEN);
+  hop -> eth . ether_type = htons (ETHERTYPE_IP);
+
+  /* Until its link-layer address is known the targets through it are pinged through the socket */
+  hop -> known = txring -> noarp || neigh_lookup (& neighs, gateway, hop -> eth . ether_dhost) == 0;
+  if (! hop -> known)
+    {
+      neigh_solicit (gateway);
+      if (! wtimer_armed (& neightimer))
+	wtimer_arm (& wheel, & neightimer, wheel . now + NEIGH_RETRY);
+    }
+
+  return nhops;
+}
+
+
+/* Ask again for the link-layer addresses of the next hops not yet known, for a while (reading the table once per pass) */
+static void neigh_cb (wtimer_t * timer, void * arg)
+{
+  int pending = 0;
+  uint32_t i;
+
+  neigh_read (& neighs, txring -> name);
+  for (i = 0; i < nhops; i ++)
+    {
+      hop_t * hop = & hops [i];
+
+      if (hop -> known || hop -> tries == NEIGH_TRIES)
+	continue;
+
+      if (neigh_lookup (& neighs, hop -> addr, hop -> eth . ether_dhost) == 0)
+	hop -> known = 1;
+      else if (++ hop -> tries == NEIGH_TRIES)
+	{
+	  out_str (& output, "no link-layer address for next hop ");
+	  out_addr (& output, hop -> addr);
+	  out_str (& output, ", pinging through it with the socket\n");
+	}
+      else
+	{
+	  neigh_solicit (hop -> addr);
+	  pending = 1;
+	}
+    }
+
+  if (pending)
+    wtimer_arm (& wheel, timer, wheel . now + NEIGH_RETRY);
+}
+
+
+/* Start to ping a target, its internet address is known */
+static void resolved (target_t * t)
+{
+  t -> resolved = 1;
+  fmtaddr (t -> ip, t -> addr . sin_addr);
+  rdns_name (& rdns, t -> addr . sin_addr);
+  if (txring)
+    t -> hop = nexthop (t);
+  wtimer_arm (& wheel, & t -> timer, wheel . now + (uint64_t) interval * (t - targets) / ntargets);
+}
+
+
+static void lookup (void);
+
+
+/* Callback for the answer to the lookup of the name of a target */
+static void lookup_cb (int result, struct evutil_addrinfo * res, void * arg)
+{
+  target_t * t = arg;
+
+  resolver . inflight --;
+  if (result == EVUTIL_EAI_CANCEL)
+    return;
+
+  if (! result && res)
+    {
+      t -> addr . sin_addr = ((struct sockaddr_in *) res -> ai_addr) -> sin_addr;
+      resolved (t);
+    }
+  else
+    {
+      out_str (& output, progname);
+      out_str (& output, ": unknown host ");
+      out_str (& output, t -> name);
+      out_str (& output, " (");
+      out_str (& output, evutil_gai_strerror (result));
+      out_str (& output, ")\n");
+      resolver . failed ++;
+    }
+  if (res)
+    evutil_freeaddrinfo (res);
+
+  out_flush (& output);
+
+  /* Nothing to ping at all */
+  if (resolver . failed == ntargets)
+    event_base_loopbreak (resolver . base);
+
+  lookup ();
+  reschedule ();
+}
+
+
+/*
+ * Start the lookups of the names of the targets, up to MAX_LOOKUPS in progress.
+ *
+ * The answer could come at once (e.g. from the hosts file), so the callback
+ * calls back here only to keep the lookups going, not recursively.
+ */
+static void lookup (void)
+{
+  struct evutil_addrinfo hints;
+
+  if (resolver . busy || ! resolver . dns)
+    return;
+
+  memset (& hints, '\0', sizeof (hints));
+  hints . ai_family = AF_INET;
+  hints . ai_socktype = SOCK_DGRAM;
+
+  resolver . busy = 1;
+  while (resolver . next < ntargets && resolver . inflight < MAX_LOOKUPS)
+    {
+      target_t * t = & targets [resolver . next ++];
+      if (t -> resolved)
+	continue;
+
+      resolver . inflight ++;
+      evdns_getaddrinfo (resolver . dns, t -> name, NULL, & hints, lookup_cb, t);
+    }
+  resolver . busy = 0;
+}
+
+
+/* Add the counters of this thread to the totals */
+static void accumulate (void)
+{
+  pthread_mutex_lock (& totals . lock);
+  totals . txpackets += tx . packets;
+  totals . txsyscalls += tx . syscalls;
+  totals . batches += tx . batches;
+  totals . partial += tx . partial;
+  totals . txerrors += tx . errors;
+  totals . rxpackets += rx . packets;
+  totals . rxsyscalls += rx . syscalls;
+  totals . wakeups += rx . wakeups;
+  totals . blocks += ring ? ring -> retired : 0;
+  totals . drops += ring ? ring -> drops : 0;
+  totals . frames += txring ? txring -> packets : 0;
+  totals . kicks += txring ? txring -> kicks : 0;
+  totals . full += txring ? txring -> full : 0;
+  totals . rejected += txring ? txring -> rejected : 0;
+  totals . enters += uring ? uring -> enters : 0;
+  totals . submitted += uring ? uring -> submitted : 0;
+  totals . completed += uring ? uring -> completed : 0;
+  totals . nobufs += uring ? uring -> nobufs : 0;
+  totals . txstamps += ntxstamps;
+  totals . badcksums += badcksums;
+  totals . baddata += baddata;
+  pthread_mutex_unlock (& totals . lock);
+}
+
+
+/*
+ * Ping the targets of a shard until its event base is told to stop (in the
+ * main thread when there is only one shard, in a thread of its own otherwise)
+ */
+static void pinger (shard_t * s)
+{
+  struct evdns_base * dns;        /* Used to look up the names of the hosts */
+  struct event * read_evt;        /* Used to detect read events */
+  uint32_t npackets;
+  uint32_t i;
+
+  /* The shard */
+  targets = s -> targets;
+  ntargets = s -> count;
+  first = s -> first;
+  whoami = s -> id;
+  fd = s -> fd;
+
+  /* The time each request in flight was sent, to give it up when not replied in time */
+  if (! (sendticks = calloc ((size_t) ntargets * winsize, sizeof (uint32_t))) ||
+      ! (states = calloc ((size_t) ntargets * winsize, sizeof (uint8_t))) ||
+      (stamps && ! (txstamps = calloc ((size_t) ntargets * TXSLOTS, sizeof (txstamp_t)))))
+    {
+      printf ("%s: out of memory while allocating the requests in flight\n", progname);
+      exit (1);
+    }
+
+  /* The templates of the requests */
+  for (i = 0; i < ntargets; i ++)
+    mkhead (& targets [i] . head, targets [i] . next, i);
+
+  /* The packet buffers, enough for a batch to transmit and a vector to receive,
+   * each one large enough for the largest reply to the requests (IP options included).
+   * With io_uring, enough for those provided to receive and a full queue to transmit,
+   * with room for what comes along with a reply */
+  if (ioring)
+    npackets = (mapped ? 0 : URING_BUFS) + URING_ENTRIES;
+  else
+    npackets = (batch > 1 ? batch : 0) + vector;
+  if (pool_init (& pool, npackets, (ioring ? RXHDRLEN : 0) + MIN (IPHDR + MAX_IPOPTLEN + pktsize, IP_MAXPACKET)) == -1)
+    {
+      printf ("%s: out of memory while allocating %u packet buffers\n", progname, npackets);
+      exit (1);
+    }
+
+  if (ioring && mkuring (progname, s) == -1)
+    exit (1);
+
+  /* The names of the targets, and of the hosts replying, are looked up asynchronously */
+  if (! (dns = evdns_base_new (s -> base, 1)))
+    {
+      printf ("%s: cannot initialize the resolver\n", progname);
+      exit (1);
+    }
+  resolver . base = s -> base;
+  resolver . dns = dns;
+
+  /* The names of the hosts replying are cached, never delaying the replies */
+  rdns_init (& rdns, numeric ? NULL : dns);
+
+  /* Add the raw file descriptor (or the receive ring) to the list of those monitored for read events */
+  rx . budget = budget;
+  if (mapped)
+    {
+      ring = & s -> ring;
+      read_evt = event_new (s -> base, ring -> fd, EV_READ | EV_PERSIST, ring_cb, NULL);
+    }
+  else if (uring)
+    read_evt = event_new (s -> base, uring -> fd, EV_READ | EV_PERSIST, uring_cb, NULL);
+  else
+    {
+      if (vector > 1)
+	mkvector (vector);
+      read_evt = event_new (s -> base, fd, EV_READ | EV_PERSIST, vector > 1 ? drain_cb : data_cb, NULL);
+    }
+  event_add (read_evt, NULL);
+
+  /* The transmit stage */
+  if (batch > 1 && ! uring)
+    mkbatch (batch);
+
+  /* The scheduler is driven by a single libevent timer, at the ticks it has something to do at */
+  wheel_init (& wheel, TICK);
+  if (txiface)
+    {
+      txring = & s -> txring;
+      wtimer_init (& neightimer, neigh_cb, NULL);
+      if (neigh_routes (& routes) == -1)
+	{
+	  printf ("%s: cannot read the routes (errno %d - %s)\n", progname, errno, strerror (errno));
+	  exit (1);
+	}
+      neigh_read (& neighs, txring -> name);
+    }
+  if (fleet . period)
+    {
+      wtimer_init (& windowtimer, window_cb, NULL);
+      wtimer_arm (& wheel, & windowtimer, wheel . now + fleet . period);
+    }
+  tick_evt = event_new (s -> base, -1, 0, tick_cb, NULL);
+  wakeup = UINT64_MAX;
+
+  /* Define the callbacks to send ping packets and start the timers spreading
+   * the first transmission of all the targets over the time interval, as soon
+   * as their internet addresses are known */
+  for (i = 0; i < ntargets; i ++)
+    {
+      wtimer_init (& targets [i] . timer, push_cb, & targets [i]);
+      wtimer_init (& targets [i] . expire, expire_cb, & targets [i]);
+      if (targets [i] . resolved)
+	resolved (& targets [i]);
+    }
+  lookup ();
+  schedule ();
+
+  /* Event dispatching loop */
+  event_base_dispatch (s -> base);
+
+  logflush ();
+  closewindow (1);
+  out_flush (& output);
+  if (ring)
+    ring_close (ring);
+  if (txring)
+    {
+      txring_close (txring);
+      neigh_routes_free (& routes);
+      neigh_free (& neighs);
+    }
+  if (uring)
+    uring_close (uring);
+  accumulate ();
+  s -> rxpackets = rx . packets;
+
+  event_free (tick_evt);
+  event_free (read_evt);
+  resolver . dns = NULL;
+  evdns_base_free (dns, 1);
+  rdns_free (& rdns);
+  pool_free (& pool);
+  free (sendticks);
+  free (states);
+  free (txstamps);
+}
+
+
+/* Ping the targets of a shard in a thread of its own */
+static void * worker (void * arg)
+{
+  if (out_init (& output, STDOUT_FILENO, OUTBUF) == -1)
+    {
+      printf ("%s: out of memory while allocating the output buffer\n", progname);
+      exit (1);
+    }
+
+  pinger (arg);
+
+  out_free (& output);
+  event_active (done_evt, 0, 0);
+
+  return NULL;
+}
+
+
+/* How to use this program */
+static void usage (char * progname)
+{
+  printf ("Usage: %s [-a] [-e] [-F] [-M] [-n] [-o] [-P] [-t] [-u] [-V] [-i msec] [-T msec] [-s size] [-b count] [-r count] [-R budget] [-j threads] [-w file] [-W sec] [-k file] [-x iface] [-f file] host [host ...]\n", progname);
+  printf ("   -a         adaptive timeout per target from its round-trip times (RFC 6298), at most -T msec\n");
+  printf ("   -b count   transmit up to count packets due at the same time with a single syscall\n");
+  printf ("   -e         report the ICMP errors (unreachable, time exceeded) about the requests (raw socket only)\n");
+  printf ("   -F         steer the replies to the ring of their thread with a fanout group (implies -M)\n");
+  printf ("   -M         receive the replies through a memory-mapped ring (AF_PACKET, TPACKET_V3)\n");
+  printf ("   -P         use a raw socket even if an ICMP datagram socket is available\n");
+  printf ("   -r count   receive up to count packets with a single syscall\n");
+  printf ("   -R budget  max # of packets received per wakeup with -r or -M (default %d)\n", DFL_BUDGET);
+  printf ("   -s size    # of data bytes to be sent (default %zu)\n", DFL_DATA_SIZE);
+  printf ("   -t         report in-host send delay and network RTT using kernel transmit timestamps\n");
+  printf ("   -u         send and receive through io_uring, submitting once per tick (instead of -b and -r)\n");
+  printf ("   -V         verify the checksum and the payload of the replies\n");
+  printf ("   -f file    read the hosts to ping from file ('-' for standard input)\n");
+  printf ("   -i msec    interval between sending packets to each host (default %d)\n", DFL_PING_INTERVAL);
+  printf ("   -j threads ping with up to %d threads, each one with a socket of its own and a share of the hosts\n", MAX_THREADS);
+  printf ("   -T msec    give up the requests not replied within msec (default %d)\n", DFL_TIMEOUT);
+  printf ("   -n         numeric output only, no attempt to look up the names of the hosts\n");
+  printf ("   -o         open-loop: send at fixed rate without waiting for replies\n");
+  printf ("   -W sec     report the round-trip times of all the targets every sec seconds\n");
+  printf ("   -k file    append the sketches of the round-trip times of all the targets to file (see sping-dump -k)\n");
+  printf ("   -x iface   transmit the requests to the hosts routed through iface with a memory-mapped ring\n");
+  printf ("   -w file    log the replies to file in binary form (see sping-dump) instead of printing them\n");
+}
+
+
+/* Like ping, but with network performances in mind */
+int main (int argc, char * argv [])
+{
+  struct event_base * base;
+  struct event * int_evt;         /* Used to terminate */
+  struct event * term_evt;
+  struct event * usr1_evt = NULL; /* Used to print the statistics */
+  struct timespec now;
+  sigset_t mask;
+  sigset_t old;
+  int option;
+  uint32_t threads = 1;
+  int raw = 0;
+  uint32_t i;
+
+  /* Notice the program name */
+  progname = strrchr (argv [0], '/');
+  progname = ! progname ? * argv : progname + 1;
+
+  /* Initialize global variables */
+  pktsize = DFL_DATA_SIZE + ICMP_MINLEN;
+  if (getrandom (& cookie, sizeof (cookie), 0) != sizeof (cookie))
+    cookie = getpid () ^ time (NULL);
+
+  interval = DFL_PING_INTERVAL;      /* interval between sending ping packets (in millisec) */
+  timeout = DFL_TIMEOUT;             /* how long the replies are waited for (in millisec) */
+
+  /* Parse command line options */
+  while ((option = getopt (argc, argv, "ab:ef:Fi:j:k:MnoPr:R:s:tT:uVw:W:x:h")) != -1)
+    switch (option)
+      {
+      case 'a':
+	adaptive = 1;
+	break;
+
+      case 'b':
+	batch = atoi (optarg);
+	if (batch < 1 || batch > MAX_BATCH)
+	  {
+	    printf ("%s: bad batch size %s (1-%d)\n", progname, optarg, MAX_BATCH);
+	    return 1;
+	  }
+	break;
+
+      case 'e':
+	errors = 1;
+	break;
+
+      case 'f':
+	if (addtargets (progname, optarg) == -1)
+	  return 1;
+	break;
+
+      case 'F':
+	fanout = 1;
+	mapped = 1;
+	break;
+
+      case 'i':
+	if (atoi (optarg) <= 0)
+	  {
+	    printf ("%s: bad timing interval %s\n", progname, optarg);
+	    return 1;
+	  }
+	interval = atoi (optarg);
+	break;
+
+      case 'j':
+	threads = atoi (optarg);
+	if (threads < 1 || threads > MAX_THREADS)
+	  {
+	    printf ("%s: bad # of threads %s (1-%d)\n", progname, optarg, MAX_THREADS);
+	    return 1;
+	  }
+	break;
+
+      case 'k':
+	fleet . file = optarg;
+	break;
+
+      case 'M':
+	mapped = 1;
+	break;
+
+      case 'n':
+	numeric = 1;
+	break;
+
+      case 'o':
+	openloop = 1;
+	break;
+
+      case 'P':
+	raw = 1;
+	break;
+
+      case 'r':
+	vector = atoi (optarg);
+	if (vector < 1 || vector > MAX_BATCH)
+	  {
+	    printf ("%s: bad vector size %s (1-%d)\n", progname, optarg, MAX_BATCH);
+	    return 1;
+	  }
+	break;
+
+      case 'R':
+	if (atoi (optarg) <= 0)
+	  {
+	    printf ("%s: bad receive budget %s\n", progname, optarg);
+	    return 1;
+	  }
+	budget = atoi (optarg);
+	break;
+
+      case 's':
+	if (atoi (optarg) < MIN_DATA_SIZE || atoi (optarg) > MAX_DATA_SIZE)
+	  {
+	    printf ("%s: bad packet size %s (%d-%d)\n", progname, optarg, (int) MIN_DATA_SIZE, (int) MAX_DATA_SIZE);
+	    return 1;
+	  }
+	pktsize = atoi (optarg) + ICMP_MINLEN;
+	break;
+
+      case 't':
+	stamps = 1;
+	break;
+
+      case 'T':
+	if (atoi (optarg) <= 0)
+	  {
+	    printf ("%s: bad timeout %s\n", progname, optarg);
+	    return 1;
+	  }
+	timeout = atoi (optarg);
+	break;
+
+      case 'u':
+	ioring = 1;
+	break;
+
+      case 'V':
+	verify = 1;
+	break;
+
+      case 'w':
+	logfile = optarg;
+	break;
+
+      case 'W':
+	if (atoi (optarg) <= 0)
+	  {
+	    printf ("%s: bad window %s\n", progname, optarg);
+	    return 1;
+	  }
+	fleet . period = atoi (optarg) * 1000;
+	break;
+
+      case 'x':
+	txiface = optarg;
+	break;
+
+      default:
+	usage (progname);
+	return option == 'h' ? 0 : 1;
+      }
+
+  /* All the remaining arguments are hosts to ping */
+  for (argv += optind; * argv; argv ++)
+    addtarget (progname, * argv);
+
+  /* Check for at least one host to ping */
+  if (! ntargets)
+    {
+      printf ("%s: missing argument\n", progname);
+      return 1;
+    }
+
+  /* The window of the requests in flight, in open-loop mode large enough for all those sent within the timeout */
+  winsize = INFLIGHT;
+  while (openloop && (uint64_t) winsize * interval <= timeout + interval && winsize < MAX_INFLIGHT)
+    winsize <<= 1;
+  if (openloop && (uint64_t) winsize * interval <= timeout + interval)
+    {
+      printf ("%s: timeout %u msec too long for the interval %u msec (more than %u requests in flight per host)\n",
+	      progname, timeout, interval, MAX_INFLIGHT);
+      return 1;
+    }
+
+  /* The shards, one per thread (as long as there are enough targets) */
+  if (threads > 1)
+    nshards = partition (progname, MIN (threads, ntargets));
+  else if ((shards = calloc (1, sizeof (shard_t))))
+    {
+      shards [0] . count = ntargets;
+      nshards = 1;
+    }
+  else
+    {
+      printf ("%s: out of memory while partitioning the targets\n", progname);
+      return 1;
+    }
+
+  /* Initialize the application: a socket per shard, each one with an identifier of its own */
+  for (i = 0; i < nshards; i ++)
+    {
+      shards [i] . targets = targets + shards [i] . first;
+      shards [i] . id = (getpid () + i) & 0xffff;
+      if ((shards [i] . fd = initialize (progname, NULL, raw || (i && ! dgram), & shards [i] . id)) == -1)
+	return 1;
+
+      if (stamps && mktxstamps (progname, shards [i] . fd) == -1)
+	return 1;
+
+      if (mapped && mkring (progname, & shards [i]) == -1)
+	return 1;
+
+      if (txiface && mktxring (progname, & shards [i]) == -1)
+	return 1;
+    }
+
+  /* The payload shared by all the requests */
+  mkpadding ();
+
+  /* The text output, written bypassing stdio from now on */
+  fflush (stdout);
+  if (out_init (& output, STDOUT_FILENO, OUTBUF) == -1)
+    {
+      printf ("%s: out of memory while allocating the output buffer\n", progname);
+      return 1;
+    }
+
+  /* The binary log of the replies, the targets are recorded by name in its header */
+  if (logfile)
+    {
+      char ** names = calloc (ntargets, sizeof (char *));
+
+      for (i = 0; names && i < ntargets; i ++)
+	names [i] = targets [i] . name;
+      if (! names || binlog_open (& binlog, logfile, names, ntargets, cookie, pktsize) == -1)
+	{
+	  printf ("%s: cannot create %s (errno %d - %s)\n", progname, logfile, errno, strerror (errno));
+	  return 1;
+	}
+      free (names);
+    }
+
+  /* The sketches of the round-trip times, appended to those already in the file */
+  if (fleet . file && (fleet . fd = open (fleet . file, O_WRONLY | O_CREAT | O_APPEND, 0644)) == -1)
+    {
+      printf ("%s: cannot open %s (errno %d - %s)\n", progname, fleet . file, errno, strerror (errno));
+      return 1;
+    }
+
+  /* The first window starts now */
+  clock_gettime (CLOCK_REALTIME, & now);
+  fleet . current . from = nsec (& now);
+  fleet . shards = nshards;
+
+  /* Initialize the libevent, its event bases are told to stop from the main thread when more than one */
+  if (nshards > 1)
+    evthread_use_pthreads ();
+  base = event_base_new ();
+  for (i = 0; i < nshards; i ++)
+    {
+      shards [i] . base = nshards > 1 ? event_base_new () : base;
+      shards [i] . usr1_evt = nshards > 1 ? event_new (shards [i] . base, -1, 0, summary_cb, NULL) : NULL;
+    }
+
+  /* Terminate gracefully on user request */
+  int_evt = evsignal_new (base, SIGINT, stop_cb, base);
+  term_evt = evsignal_new (base, SIGTERM, stop_cb, base);
+  event_add (int_evt, NULL);
+  event_add (term_evt, NULL);
+
+  /* Print the statistics on user request */
+  usr1_evt = evsignal_new (base, SIGUSR1, nshards > 1 ? usr1_cb : summary_cb, NULL);
+  event_add (usr1_evt, NULL);
+
+  if (nshards == 1)
+    pinger (& shards [0]);
+  else
+    {
+      /* The threads leave the signals to the main thread */
+      done_evt = event_new (base, -1, 0, done_cb, base);
+      sigemptyset (& mask);
+      sigaddset (& mask, SIGINT);
+      sigaddset (& mask, SIGTERM);
+      sigaddset (& mask, SIGUSR1);
+      pthread_sigmask (SIG_BLOCK, & mask, & old);
+      for (i = 0; i < nshards; i ++)
+	if ((errno = pthread_create (& shards [i] . thread, NULL, worker, & shards [i])))
+	  {
+	    printf ("%s: cannot create thread (errno %d - %s)\n", progname, errno, strerror (errno));
+	    exit (1);
+	  }
+      pthread_sigmask (SIG_SETMASK, & old, NULL);
+
+      /* Wait for a signal, or for all the threads to be done */
+      event_base_dispatch (base);
+      stop_cb (-1, 0, base);
+      for (i = 0; i < nshards; i ++)
+	pthread_join (shards [i] . thread, NULL);
+      event_free (done_evt);
+    }
+
+  summary (1);
+  out_free (& output);
+  if (logfile)
+    binlog_close (& binlog);
+  txstats ();
+
+  /* Terminate the libevent library */
+  event_free (int_evt);
+  event_free (term_evt);
+  event_free (usr1_evt);
+  for (i = 0; i < nshards; i ++)
+    {
+      close (shards [i] . fd);
+      if (shards [i] . usr1_evt)
+	event_free (shards [i] . usr1_evt);
+      if (shards [i] . base != base)
+	event_base_free (shards [i] . base);
+    }
   event_base_free (base);
+  for (i = 0; i < ntargets; i ++)
+    stats_free (& targets [i] . rtts);
+  free (targets);
+  free (shards);
+  if (fleet . fd != -1)
+    close (fleet . fd);
 
   return 0;
 }
@@ -0,0 +1,137 @@
+/*
+ * stats.c - Streaming statistics of round-trip times for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * No sample is kept: adding one updates the counters, the mean and the
+ * variance (Welford's algorithm, numerically stable) and a log-linear
+ * histogram (like HdrHistogram) in O(1), and the quantiles are read from
+ * the histogram.  The memory is fixed (STATS_BUCKETS * 4 bytes, about 1.5KB)
+ * and allocated with the first sample, so targets never replying cost nothing.
+ */
+
+
+/* Operating System header file(s) */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* Private header file(s) */
+#include "stats.h"
+
+
+/* Return the bucket of a sample (in microseconds) */
+static uint32_t bucket (uint64_t us)
+{
+  int shift;
+
+  if (us < STATS_SUB)
+    return us;
+  if (us >> STATS_MAX_BITS)
+    return STATS_BUCKETS - 1;
+
+  /* Keep the STATS_SUB_BITS - 1 bits after the most significant one */
+  shift = 63 - __builtin_clzll (us) - (STATS_SUB_BITS - 1);
+
+  return STATS_SUB + (shift - 1) * STATS_HALF + (us >> shift) - STATS_HALF;
+}
+
+
+/* Return the value (in nanoseconds) a bucket stands for: the middle of its range */
+static int64_t middle (uint32_t b)
+{
+  int shift;
+
+  if (b < STATS_SUB)
+    return b * 1000 + 500;
+
+  shift = (b - STATS_SUB) / STATS_HALF + 1;
+
+  return ((((uint64_t) (b - STATS_SUB) % STATS_HALF + STATS_HALF) << shift) + (1 << (shift - 1))) * 1000;
+}
+
+
+/* Start with no samples */
+void stats_init (stats_t * stats)
+{
+  memset (stats, '\0', sizeof (stats_t));
+}
+
+
+/* Release the histogram */
+void stats_free (stats_t * stats)
+{
+  free (stats -> hist);
+  stats_init (stats);
+}
+
+
+/* Add a sample */
+void stats_add (stats_t * stats, int64_t ns)
+{
+  double delta;
+
+  if (ns < 0)
+    ns = 0;
+
+  if (! stats -> hist && ! (stats -> hist = calloc (STATS_BUCKETS, sizeof (uint32_t))))
+    return;
+
+  if (! stats -> count || ns < stats -> min)
+    stats -> min = ns;
+  if (! stats -> count || ns > stats -> max)
+    stats -> max = ns;
+
+  stats -> count ++;
+  delta = ns - stats -> mean;
+  stats -> mean += delta / stats -> count;
+  stats -> m2 += delta * (ns - stats -> mean);
+
+  stats -> hist [bucket (ns / 1000)] ++;
+}
+
+
+/* Return the standard deviation of the samples (as ping's mdev) */
+double stats_stddev (stats_t * stats)
+{
+  return stats -> count ? sqrt (stats -> m2 / stats -> count) : 0.0;
+}
+
+
+/* Return the q-quantile (0 < q <= 1) of the samples, within the smallest and the largest */
+int64_t stats_quantile (stats_t * stats, double q)
+{
+  uint64_t rank = ceil (q * stats -> count);
+  uint64_t seen = 0;
+  int64_t value = stats -> max;
+  uint32_t b;
+
+  if (! stats -> count)
+    return 0;
+
+  for (b = 0; b < STATS_BUCKETS; b ++)
+    if ((seen += stats -> hist [b]) >= rank)
+      {
+	value = middle (b);
+	break;
+      }
+
+  return value < stats -> min ? stats -> min : value > stats -> max ? stats -> max : value;
+}
@@ -0,0 +1,57 @@
+/*
+ * stats.h - Streaming statistics of round-trip times for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+
+
+/*
+ * The histogram counts the samples in microseconds, exactly below 32 usec
+ * and then in 16 buckets per power of 2 (relative error at most 1/32 when
+ * reported at the middle of a bucket) up to 2^26 usec (about 67 seconds),
+ * the samples over it are counted in the last bucket.
+ */
+#define STATS_SUB_BITS  5
+#define STATS_SUB       (1 << STATS_SUB_BITS)          /* exact values   */
+#define STATS_HALF      (STATS_SUB / 2)                /* buckets per power of 2 */
+#define STATS_MAX_BITS  26
+#define STATS_BUCKETS   (STATS_SUB + (STATS_MAX_BITS - STATS_SUB_BITS) * STATS_HALF)
+
+
+/* Running statistics of a series of samples (in nanoseconds) */
+typedef struct
+{
+  uint64_t count;                 /* # of samples                             */
+  int64_t min;                    /* smallest sample                          */
+  int64_t max;                    /* largest sample                           */
+  double mean;                    /* running mean (Welford)                   */
+  double m2;                      /* running sum of squared differences from the mean */
+  uint32_t * hist;                /* STATS_BUCKETS counters, allocated with the first sample */
+} stats_t;
+
+
+void stats_init (stats_t * stats);
+void stats_free (stats_t * stats);
+void stats_add (stats_t * stats, int64_t ns);
+double stats_stddev (stats_t * stats);
+int64_t stats_quantile (stats_t * stats, double q);
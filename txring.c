@@ -0,0 +1,252 @@
+/*
+ * txring.c - Memory-mapped transmit ring (AF_PACKET) for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * The frames, complete with their link-layer and IP headers, are built
+ * straight into a ring of slots mapped in the address space of the program
+ * and marked as ready, then a single system call (a kick) has the kernel
+ * send all those ready, bypassing the IP stack and the queueing discipline
+ * of the interface.  A slot is available again once its frame has been sent.
+ *
+ * All the frames are built in the same way, so the part which never changes
+ * (the payload) needs to be written only the first time a slot is filled.
+ *
+ * The kernel stops at the first frame it rejects (marked as of wrong format),
+ * and would go on with the others only once that one is handed over again:
+ * it is then emptied, down to its link-layer header, and the kick repeated.
+ */
+
+
+/* Operating System header file(s) */
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+/* Private header file(s) */
+#include "txring.h"
+
+
+/* Where the frame starts in a slot */
+#define DATA(slot)      ((u_char *) (slot) + TPACKET2_HDRLEN - sizeof (struct sockaddr_ll))
+
+
+/* Return the slot of a frame */
+static struct tpacket2_hdr * slot (txring_t * ring, uint32_t n)
+{
+  return (struct tpacket2_hdr *) (ring -> map + (size_t) n * ring -> size);
+}
+
+
+/* Learn what is needed about the interface */
+static int interface (txring_t * ring, char * iface)
+{
+  struct ifreq ifr;
+
+  memset (& ifr, '\0', sizeof (ifr));
+  strncpy (ifr . ifr_name, iface, IFNAMSIZ - 1);
+  strcpy (ring -> name, ifr . ifr_name);
+
+  if (ioctl (ring -> fd, SIOCGIFINDEX, & ifr) == -1)
+    return -1;
+  ring -> ifindex = ifr . ifr_ifindex;
+
+  if (ioctl (ring -> fd, SIOCGIFHWADDR, & ifr) == -1)
+    return -1;
+  memcpy (ring -> mac, ifr . ifr_hwaddr . sa_data, ETH_ALEN);
+
+  if (ioctl (ring -> fd, SIOCGIFMTU, & ifr) == -1)
+    return -1;
+  ring -> mtu = ifr . ifr_mtu;
+
+  if (ioctl (ring -> fd, SIOCGIFFLAGS, & ifr) == -1)
+    return -1;
+  ring -> noarp = (ifr . ifr_flags & (IFF_NOARP | IFF_LOOPBACK)) != 0;
+
+  return 0;
+}
+
+
+/*
+ * Create the socket on an interface and map its ring, for frames up to len
+ * bytes (link-layer header included), return -1 on error (errno is set)
+ */
+int txring_open (txring_t * ring, char * iface, uint32_t len)
+{
+  int version = TPACKET_V2;
+  int on = 1;
+  struct tpacket_req req;
+  uint32_t size = TPACKET_ALIGNMENT;
+  int err;
+
+  memset (ring, '\0', sizeof (txring_t));
+
+  /* No protocol, the socket never receives */
+  if ((ring -> fd = socket (AF_PACKET, SOCK_RAW, 0)) == -1)
+    return -1;
+
+  if (interface (ring, iface) == -1)
+    goto fail;
+
+  /* A power of 2, so that the frames are packed in the blocks */
+  while (size < TPACKET2_HDRLEN - sizeof (struct sockaddr_ll) + len)
+    size <<= 1;
+
+  memset (& req, '\0', sizeof (req));
+  req . tp_frame_size = size;
+  req . tp_block_size = size > TXRING_BLOCK ? size : TXRING_BLOCK;
+  req . tp_frame_nr = TXRING_BYTES / size > TXRING_MIN ? TXRING_BYTES / size : TXRING_MIN;
+  req . tp_block_nr = (uint64_t) req . tp_frame_nr * size / req . tp_block_size;
+  req . tp_frame_nr = (uint64_t) req . tp_block_nr * req . tp_block_size / size;
+
+  if (setsockopt (ring -> fd, SOL_PACKET, PACKET_VERSION, & version, sizeof (version)) == -1 ||
+      setsockopt (ring -> fd, SOL_PACKET, PACKET_TX_RING, & req, sizeof (req)) == -1 ||
+      (ring -> map = mmap (NULL, (size_t) req . tp_block_nr * req . tp_block_size,
+			   PROT_READ | PROT_WRITE, MAP_SHARED, ring -> fd, 0)) == MAP_FAILED)
+    goto fail;
+
+  /* Straight to the driver (when supported) */
+  setsockopt (ring -> fd, SOL_PACKET, PACKET_QDISC_BYPASS, & on, sizeof (on));
+
+  ring -> frames = req . tp_frame_nr;
+  ring -> size = size;
+
+  ring -> sll . sll_family = AF_PACKET;
+  ring -> sll . sll_protocol = htons (ETH_P_IP);
+  ring -> sll . sll_ifindex = ring -> ifindex;
+
+  return ring -> fd;
+
+ fail:
+  err = errno;
+  close (ring -> fd);
+  ring -> map = NULL;
+  errno = err;
+  return -1;
+}
+
+
+/* Unmap the ring and close the socket */
+void txring_close (txring_t * ring)
+{
+  munmap (ring -> map, (size_t) ring -> frames * ring -> size);
+  close (ring -> fd);
+  ring -> map = NULL;
+}
+
+
+/*
+ * Return where to build the next frame, NULL when the ring is full.
+ * The slot has never been filled before when fresh (what never changes
+ * from one frame to the next has to be written too).
+ */
+u_char * txring_frame (txring_t * ring, int * fresh)
+{
+  struct tpacket2_hdr * hdr = slot (ring, ring -> next);
+  uint32_t status = __atomic_load_n (& hdr -> tp_status, __ATOMIC_ACQUIRE);
+
+  if (status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING))
+    {
+      ring -> full ++;
+      return NULL;
+    }
+
+  /* The slot is that of the oldest frame handed over, which has been sent then */
+  if (ring -> unsent == ring -> frames)
+    {
+      ring -> head = (ring -> head + 1) % ring -> frames;
+      ring -> unsent --;
+    }
+
+  * fresh = ring -> filled < ring -> frames;
+
+  return DATA (hdr);
+}
+
+
+/* Mark the frame just built (of len bytes) as ready to be sent at the next kick */
+void txring_send (txring_t * ring, uint32_t len)
+{
+  struct tpacket2_hdr * hdr = slot (ring, ring -> next);
+
+  hdr -> tp_len = len;
+  __atomic_store_n (& hdr -> tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+  ring -> next = (ring -> next + 1) % ring -> frames;
+  ring -> queued ++;
+  ring -> unsent ++;
+  ring -> filled ++;
+  ring -> packets ++;
+}
+
+
+/*
+ * Look for the frame the kernel has stopped at, from the oldest handed over,
+ * and empty it if rejected.  Return 0 if there was none.
+ */
+static int reject (txring_t * ring)
+{
+  while (ring -> unsent)
+    {
+      struct tpacket2_hdr * hdr = slot (ring, ring -> head);
+      uint32_t status = __atomic_load_n (& hdr -> tp_status, __ATOMIC_ACQUIRE);
+
+      if (status & TP_STATUS_SEND_REQUEST)
+	return 0;
+
+      if (status & TP_STATUS_WRONG_FORMAT)
+	{
+	  hdr -> tp_len = ETH_HLEN;
+	  __atomic_store_n (& hdr -> tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+	  ring -> rejected ++;
+	  return 1;
+	}
+
+      /* Sent (or being sent) */
+      ring -> head = (ring -> head + 1) % ring -> frames;
+      ring -> unsent --;
+    }
+
+  return 0;
+}
+
+
+/* Have the kernel send all the frames ready, without waiting for them to leave */
+int txring_kick (txring_t * ring)
+{
+  int n;
+
+  if (! ring -> queued)
+    return 0;
+
+  ring -> queued = 0;
+  do
+    {
+      ring -> kicks ++;
+      n = sendto (ring -> fd, NULL, 0, MSG_DONTWAIT, (struct sockaddr *) & ring -> sll, sizeof (ring -> sll));
+    }
+  while (n == -1 && reject (ring));
+
+  return n;
+}
@@ -0,0 +1,71 @@
+/*
+ * txring.h - Memory-mapped transmit ring (AF_PACKET) for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+#include <sys/types.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+
+
+/* Room for the frames in the ring (whatever their size, at least TXRING_MIN of them) */
+#define TXRING_BYTES    (8 * 1024 * 1024)
+#define TXRING_MIN      64
+#define TXRING_BLOCK    (64 * 1024)
+
+
+/* A transmit ring shared with the kernel, on a given interface */
+typedef struct
+{
+  int fd;                         /* the packet socket                        */
+  u_char * map;                   /* the frames, mapped                       */
+  uint32_t frames;                /* # of frames                              */
+  uint32_t size;                  /* size of a frame                          */
+  uint32_t next;                  /* next frame to be filled                  */
+  uint32_t head;                  /* oldest frame handed over, maybe not sent yet */
+  uint32_t unsent;                /* # of those from it, up to the next one   */
+  uint32_t queued;                /* # of frames filled since the last kick   */
+  uint64_t filled;                /* # of frames filled so far                */
+  struct sockaddr_ll sll;         /* where the frames go                      */
+
+  /* The interface */
+  char name [IFNAMSIZ];
+  int ifindex;
+  u_char mac [ETH_ALEN];          /* its link-layer address                   */
+  uint32_t mtu;
+  int noarp;                      /* no link-layer address resolution (e.g. loopback) */
+
+  /* Counters */
+  uint64_t packets;               /* # of frames handed over to the kernel    */
+  uint64_t kicks;                 /* # of system calls to have them sent      */
+  uint64_t full;                  /* # of frames not filled, the ring was full */
+  uint64_t rejected;              /* # of frames rejected by the kernel (sent empty) */
+} txring_t;
+
+
+int txring_open (txring_t * ring, char * iface, uint32_t len);
+void txring_close (txring_t * ring);
+u_char * txring_frame (txring_t * ring, int * fresh);
+void txring_send (txring_t * ring, uint32_t len);
+int txring_kick (txring_t * ring);
@@ -0,0 +1,232 @@
+/*
+ * uring.c - Asynchronous I/O with io_uring for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * The operations are described in entries of a submission queue shared
+ * with the kernel, which are handed over all together with one system
+ * call, and their results are read from a completion queue shared too,
+ * with no system call at all.
+ *
+ * The program provides the kernel with a ring of buffers to receive into:
+ * a single request on a socket (multishot) then completes once per packet
+ * received, in a buffer taken from the ring, until given back.
+ *
+ * Only the system calls are used (no liburing), with the memory barriers
+ * the kernel expects on the heads and the tails of the queues.
+ */
+
+
+/* Operating System header file(s) */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* Private header file(s) */
+#include "uring.h"
+
+
+/* Create the instance and map its queues, return -1 on error (errno is set) */
+int uring_open (uring_t * uring, uint32_t entries)
+{
+  struct io_uring_params p;
+  uint32_t i;
+  int err;
+
+  memset (uring, '\0', sizeof (uring_t));
+
+  /* Completions are posted when the program enters the kernel, no interrupt is needed */
+  memset (& p, '\0', sizeof (p));
+  p . flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+  p . cq_entries = entries * 4;
+  if ((uring -> fd = syscall (__NR_io_uring_setup, entries, & p)) == -1 && errno == EINVAL)
+    {
+      /* An older kernel */
+      p . flags = IORING_SETUP_CQSIZE;
+      uring -> fd = syscall (__NR_io_uring_setup, entries, & p);
+    }
+  if (uring -> fd == -1)
+    return -1;
+
+  uring -> sqlen = p . sq_off . array + p . sq_entries * sizeof (uint32_t);
+  uring -> cqlen = p . cq_off . cqes + p . cq_entries * sizeof (struct io_uring_cqe);
+  if (p . features & IORING_FEAT_SINGLE_MMAP)
+    uring -> sqlen = uring -> cqlen = uring -> sqlen > uring -> cqlen ? uring -> sqlen : uring -> cqlen;
+
+  if ((uring -> sqmap = mmap (NULL, uring -> sqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			      uring -> fd, IORING_OFF_SQ_RING)) == MAP_FAILED)
+    uring -> sqmap = NULL;
+  else if (p . features & IORING_FEAT_SINGLE_MMAP)
+    uring -> cqmap = uring -> sqmap;
+  else if ((uring -> cqmap = mmap (NULL, uring -> cqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				   uring -> fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+    uring -> cqmap = NULL;
+
+  if (! uring -> sqmap || ! uring -> cqmap ||
+      (uring -> sqes = mmap (NULL, p . sq_entries * sizeof (struct io_uring_sqe), PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, uring -> fd, IORING_OFF_SQES)) == MAP_FAILED)
+    {
+      err = errno;
+      uring -> sqes = NULL;
+      uring_close (uring);
+      errno = err;
+      return -1;
+    }
+
+  uring -> sqhead = (uint32_t *) (uring -> sqmap + p . sq_off . head);
+  uring -> sqtail = (uint32_t *) (uring -> sqmap + p . sq_off . tail);
+  uring -> sqmask = * (uint32_t *) (uring -> sqmap + p . sq_off . ring_mask);
+  uring -> sqentries = p . sq_entries;
+  uring -> cqhead = (uint32_t *) (uring -> cqmap + p . cq_off . head);
+  uring -> cqtail = (uint32_t *) (uring -> cqmap + p . cq_off . tail);
+  uring -> cqmask = * (uint32_t *) (uring -> cqmap + p . cq_off . ring_mask);
+  uring -> cqes = (struct io_uring_cqe *) (uring -> cqmap + p . cq_off . cqes);
+
+  /* The entries are always used in the order of the queue */
+  for (i = 0; i < p . sq_entries; i ++)
+    ((uint32_t *) (uring -> sqmap + p . sq_off . array)) [i] = i;
+
+  return uring -> fd;
+}
+
+
+/* Unmap the queues and the ring of the buffers provided, and close the instance */
+void uring_close (uring_t * uring)
+{
+  if (uring -> sqes)
+    munmap (uring -> sqes, uring -> sqentries * sizeof (struct io_uring_sqe));
+  if (uring -> cqmap && uring -> cqmap != uring -> sqmap)
+    munmap (uring -> cqmap, uring -> cqlen);
+  if (uring -> sqmap)
+    munmap (uring -> sqmap, uring -> sqlen);
+  if (uring -> br)
+    munmap (uring -> br, uring -> nbufs * sizeof (struct io_uring_buf));
+  close (uring -> fd);
+  free (uring -> bufs);
+
+  uring -> sqmap = uring -> cqmap = NULL;
+  uring -> sqes = NULL;
+  uring -> br = NULL;
+  uring -> bufs = NULL;
+}
+
+
+/* Provide the kernel with nbufs buffers (a power of 2) of the given size to receive into, their id is their index */
+int uring_provide (uring_t * uring, u_char ** bufs, uint32_t nbufs, uint32_t size)
+{
+  struct io_uring_buf_reg reg;
+  uint32_t i;
+
+  if ((uring -> br = mmap (NULL, nbufs * sizeof (struct io_uring_buf), PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+    {
+      uring -> br = NULL;
+      return -1;
+    }
+  uring -> nbufs = nbufs;
+  uring -> bufsize = size;
+
+  memset (& reg, '\0', sizeof (reg));
+  reg . ring_addr = (uintptr_t) uring -> br;
+  reg . ring_entries = nbufs;
+  reg . bgid = URING_GROUP;
+  if (! (uring -> bufs = calloc (nbufs, sizeof (u_char *))) ||
+      syscall (__NR_io_uring_register, uring -> fd, IORING_REGISTER_PBUF_RING, & reg, 1) == -1)
+    return -1;
+
+  for (i = 0; i < nbufs; i ++)
+    {
+      uring -> bufs [i] = bufs [i];
+      uring_recycle (uring, i);
+    }
+
+  return 0;
+}
+
+
+/* Give a buffer back to the kernel, once its packet has been read */
+void uring_recycle (uring_t * uring, uint16_t id)
+{
+  uint16_t tail = uring -> br -> tail;
+  struct io_uring_buf * buf = & uring -> br -> bufs [tail & (uring -> nbufs - 1)];
+
+  buf -> addr = (uintptr_t) uring -> bufs [id];
+  buf -> len = uring -> bufsize;
+  buf -> bid = id;
+  __atomic_store_n (& uring -> br -> tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+/* Return the next entry of the submission queue to be filled in (cleared), NULL when full */
+struct io_uring_sqe * uring_sqe (uring_t * uring)
+{
+  uint32_t tail = * uring -> sqtail + uring -> pending;
+  struct io_uring_sqe * sqe;
+
+  if (tail - __atomic_load_n (uring -> sqhead, __ATOMIC_ACQUIRE) >= uring -> sqentries)
+    return NULL;
+
+  sqe = & uring -> sqes [tail & uring -> sqmask];
+  memset (sqe, '\0', sizeof (struct io_uring_sqe));
+  uring -> pending ++;
+
+  return sqe;
+}
+
+
+/* Hand over to the kernel all the entries filled in, return the # of those it has taken (-1 on error) */
+int uring_submit (uring_t * uring)
+{
+  uint32_t tail = * uring -> sqtail + uring -> pending;
+  int n;
+
+  __atomic_store_n (uring -> sqtail, tail, __ATOMIC_RELEASE);
+  uring -> pending = 0;
+
+  n = syscall (__NR_io_uring_enter, uring -> fd, tail - __atomic_load_n (uring -> sqhead, __ATOMIC_ACQUIRE), 0, 0, NULL, 0);
+  uring -> enters ++;
+  if (n > 0)
+    uring -> submitted += n;
+
+  return n;
+}
+
+
+/* Return the next completion, NULL if none */
+struct io_uring_cqe * uring_cqe (uring_t * uring)
+{
+  uint32_t head = * uring -> cqhead;
+
+  if (head == __atomic_load_n (uring -> cqtail, __ATOMIC_ACQUIRE))
+    return NULL;
+
+  return & uring -> cqes [head & uring -> cqmask];
+}
+
+
+/* Done with the completion returned by uring_cqe () */
+void uring_seen (uring_t * uring)
+{
+  __atomic_store_n (uring -> cqhead, * uring -> cqhead + 1, __ATOMIC_RELEASE);
+  uring -> completed ++;
+}
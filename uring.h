@@ -0,0 +1,76 @@
+/*
+ * uring.h - Asynchronous I/O with io_uring for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+
+/* Geometry of the queues */
+#define URING_ENTRIES   4096               /* submission queue, the completion queue is 4 times larger */
+#define URING_BUFS      1024               /* buffers provided to receive (a power of 2) */
+#define URING_GROUP     0                  /* their group                              */
+
+
+/* The queues shared with the kernel, and the buffers provided to it */
+typedef struct
+{
+  int fd;                         /* the io_uring instance                    */
+  u_char * sqmap;                 /* the submission queue, mapped             */
+  u_char * cqmap;                 /* the completion queue, mapped (maybe the same) */
+  struct io_uring_sqe * sqes;     /* the submission queue entries, mapped     */
+  size_t sqlen;
+  size_t cqlen;
+  uint32_t * sqhead;
+  uint32_t * sqtail;
+  uint32_t sqmask;
+  uint32_t sqentries;
+  uint32_t pending;               /* # of entries filled in, not submitted yet */
+  uint32_t * cqhead;
+  uint32_t * cqtail;
+  uint32_t cqmask;
+  struct io_uring_cqe * cqes;
+
+  /* Buffers provided to receive */
+  struct io_uring_buf_ring * br;  /* their ring, mapped                       */
+  u_char ** bufs;                 /* the buffers, by id                       */
+  uint32_t nbufs;
+  uint32_t bufsize;
+
+  /* Counters */
+  uint64_t enters;                /* # of system calls                        */
+  uint64_t submitted;             /* # of entries submitted                   */
+  uint64_t completed;             /* # of completions                         */
+  uint64_t nobufs;                /* # of times the buffers ran out           */
+} uring_t;
+
+
+int uring_open (uring_t * uring, uint32_t entries);
+void uring_close (uring_t * uring);
+int uring_provide (uring_t * uring, u_char ** bufs, uint32_t nbufs, uint32_t size);
+void uring_recycle (uring_t * uring, uint16_t id);
+struct io_uring_sqe * uring_sqe (uring_t * uring);
+int uring_submit (uring_t * uring);
+struct io_uring_cqe * uring_cqe (uring_t * uring);
+void uring_seen (uring_t * uring);
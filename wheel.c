@@ -0,0 +1,279 @@
+/*
+ * wheel.c - Hierarchical timing wheel for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Timers due within 256 ticks live in the 256 slots of level 0, those due
+ * within 256^2 ticks in level 1 (a slot every 256 ticks) and so on.
+ * Every 256 ticks the next slot of level 1 is cascaded, that is its timers
+ * are moved down to level 0 (and so on for the upper levels), where they
+ * are going to be fired all together when the wheel reaches their slot.
+ *
+ * Arming and cancelling a timer are O(1), firing is O(1) per timer plus
+ * an amortized O(1) per tick for cascading.
+ */
+
+
+/* Operating System header file(s) */
+#include <time.h>
+
+/* Private header file(s) */
+#include "wheel.h"
+
+
+/* Slot of a level at a given time */
+#define SLOT(t, level)  (((t) >> ((level) * WHEEL_BITS)) & WHEEL_MASK)
+
+
+/* Circular lists with the slot itself as sentinel */
+static void unlink_timer (wtimer_t * timer)
+{
+  timer -> prev -> next = timer -> next;
+  timer -> next -> prev = timer -> prev;
+  timer -> next = timer -> prev = NULL;
+}
+
+
+static void link_timer (wtimer_t * head, wtimer_t * timer)
+{
+  timer -> next = head;
+  timer -> prev = head -> prev;
+  head -> prev -> next = timer;
+  head -> prev = timer;
+}
+
+
+/* Move all the timers of a list to an empty one */
+static void splice (wtimer_t * from, wtimer_t * to)
+{
+  if (from -> next == from)
+    to -> next = to -> prev = to;
+  else
+    {
+      to -> next = from -> next;
+      to -> prev = from -> prev;
+      to -> next -> prev = to;
+      to -> prev -> next = to;
+      from -> next = from -> prev = from;
+    }
+}
+
+
+/* Put a timer in the slot of the lowest level that covers its expiration time */
+static void place (wheel_t * wheel, wtimer_t * timer)
+{
+  uint64_t delta;
+  int level;
+
+  if (timer -> expires < wheel -> now)
+    timer -> expires = wheel -> now;
+
+  delta = timer -> expires - wheel -> now;
+  for (level = 0; level < WHEEL_LEVELS - 1; level ++)
+    if (delta < (uint64_t) 1 << ((level + 1) * WHEEL_BITS))
+      break;
+
+  /* Too far in the future, park it in the last slot of the last level: it will be re-placed when cascaded */
+  if (delta >= (uint64_t) 1 << (WHEEL_LEVELS * WHEEL_BITS))
+    link_timer (& wheel -> slots [level] [SLOT (wheel -> now - 1, level)], timer);
+  else
+    link_timer (& wheel -> slots [level] [SLOT (timer -> expires, level)], timer);
+}
+
+
+/* Move down the timers of the current slot of a level and return its index */
+static int cascade (wheel_t * wheel, int level)
+{
+  int slot = SLOT (wheel -> now, level);
+  wtimer_t list;
+
+  splice (& wheel -> slots [level] [slot], & list);
+  while (list . next != & list)
+    {
+      wtimer_t * timer = list . next;
+      unlink_timer (timer);
+      place (wheel, timer);
+    }
+
+  return slot;
+}
+
+
+/* Initialize an empty wheel with the given tick duration (in nanoseconds) */
+void wheel_init (wheel_t * wheel, uint64_t tick)
+{
+  int level;
+  int slot;
+
+  for (level = 0; level < WHEEL_LEVELS; level ++)
+    for (slot = 0; slot < WHEEL_SLOTS; slot ++)
+      wheel -> slots [level] [slot] . next = wheel -> slots [level] [slot] . prev = & wheel -> slots [level] [slot];
+
+  wheel -> tick = tick;
+  wheel -> armed = 0;
+  wheel -> now = wheel_clock (wheel);
+  wheel -> soonest = UINT64_MAX;
+}
+
+
+/* Return the current time (in ticks) of the monotonic clock */
+uint64_t wheel_clock (wheel_t * wheel)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, & ts);
+
+  return ((uint64_t) ts . tv_sec * 1000000000 + ts . tv_nsec) / wheel -> tick;
+}
+
+
+/*
+ * Process all the ticks up to 'now' (included) firing the expired timers,
+ * slot by slot.  The callbacks are free to arm and cancel any timer,
+ * those armed to expire in the past are going to be fired at the next tick.
+ *
+ * Return the number of timers fired.
+ */
+unsigned wheel_advance (wheel_t * wheel, uint64_t now)
+{
+  unsigned fired = 0;
+
+  while (wheel -> now <= now)
+    {
+      wtimer_t list;
+      int slot;
+
+      /* Nothing to do at all: jump directly to the end */
+      if (! wheel -> armed)
+	{
+	  wheel -> now = now + 1;
+	  break;
+	}
+
+      /* Cascade the upper levels when level 0 wraps around */
+      slot = SLOT (wheel -> now, 0);
+      if (! slot)
+	{
+	  int level;
+	  for (level = 1; level < WHEEL_LEVELS && ! cascade (wheel, level); level ++)
+	    ;
+	}
+
+      /* Detach the whole slot before firing its timers */
+      splice (& wheel -> slots [0] [slot], & list);
+      wheel -> now ++;
+
+      while (list . next != & list)
+	{
+	  wtimer_t * timer = list . next;
+	  unlink_timer (timer);
+	  wheel -> armed --;
+	  fired ++;
+	  timer -> cb (timer, timer -> arg);
+	}
+    }
+
+  return fired;
+}
+
+
+/*
+ * Return the first tick wheel_advance () has something to do at, looking at
+ * most WHEEL_SLOTS ticks ahead (the tick after them is returned otherwise):
+ * that of the first slot of level 0 with timers, or the time the upper
+ * levels are cascaded when they have timers to move down.  UINT64_MAX
+ * when no timer is armed at all.
+ *
+ * The caller is then told, by 'soonest', about the timers armed earlier.
+ */
+uint64_t wheel_next (wheel_t * wheel)
+{
+  uint64_t t;
+
+  wheel -> soonest = UINT64_MAX;
+  if (! wheel -> armed)
+    return UINT64_MAX;
+
+  for (t = wheel -> now; t < wheel -> now + WHEEL_SLOTS; t ++)
+    {
+      wtimer_t * slot;
+      int level;
+
+      /* The upper levels are cascaded when level 0 wraps around, as far as their slots wrap around too */
+      if (! SLOT (t, 0))
+	for (level = 1; level < WHEEL_LEVELS; level ++)
+	  {
+	    slot = & wheel -> slots [level] [SLOT (t, level)];
+	    if (slot -> next != slot)
+	      return t;
+	    if (SLOT (t, level))
+	      break;
+	  }
+
+      slot = & wheel -> slots [0] [SLOT (t, 0)];
+      if (slot -> next != slot)
+	return t;
+    }
+
+  return t;
+}
+
+
+/* Initialize a timer (not armed) */
+void wtimer_init (wtimer_t * timer, wheel_cb_t * cb, void * arg)
+{
+  timer -> next = timer -> prev = NULL;
+  timer -> expires = 0;
+  timer -> cb = cb;
+  timer -> arg = arg;
+}
+
+
+/* (Re)arm a timer to expire at the given absolute time (in ticks) */
+void wtimer_arm (wheel_t * wheel, wtimer_t * timer, uint64_t expires)
+{
+  if (wtimer_armed (timer))
+    wtimer_cancel (wheel, timer);
+
+  timer -> expires = expires;
+  place (wheel, timer);
+  wheel -> armed ++;
+
+  if (timer -> expires < wheel -> soonest)
+    wheel -> soonest = timer -> expires;
+}
+
+
+/* Cancel a timer, if armed */
+void wtimer_cancel (wheel_t * wheel, wtimer_t * timer)
+{
+  if (wtimer_armed (timer))
+    {
+      unlink_timer (timer);
+      wheel -> armed --;
+    }
+}
+
+
+/* Return non-zero if the timer is armed */
+int wtimer_armed (wtimer_t * timer)
+{
+  return timer -> next != NULL;
+}
@@ -0,0 +1,75 @@
+/*
+ * wheel.h - Hierarchical timing wheel for 'sping'
+ *
+ * Copyright (C) 2009-2016 Rocco Carbone <rocco@tecsiel.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+
+/* Operating System header file(s) */
+#include <stdint.h>
+
+
+/* 4 levels of 256 slots each cover 2^32 ticks (about 49 days at 1 msec per tick) */
+#define WHEEL_BITS      8
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    4
+
+
+typedef struct wtimer wtimer_t;
+
+/* The function called at expiration time */
+typedef void wheel_cb_t (wtimer_t * timer, void * arg);
+
+
+/*
+ * A timer.  It is meant to be embedded in the object it schedules, so that
+ * arming and cancelling never allocate: a timer is linked in the list of
+ * its slot and (un)linking it costs O(1) whatever the number of timers.
+ */
+struct wtimer
+{
+  wtimer_t * next;                /* next timer in the same slot              */
+  wtimer_t * prev;                /* previous timer in the same slot          */
+  uint64_t expires;               /* absolute expiration time (in ticks)      */
+  wheel_cb_t * cb;                /* function to call at expiration time      */
+  void * arg;                     /* and its argument                         */
+};
+
+
+/* The wheel: a circular list of timers per slot per level */
+typedef struct
+{
+  uint64_t tick;                  /* duration of a tick (in nanoseconds)      */
+  uint64_t now;                   /* next tick to be processed                */
+  uint64_t soonest;               /* earliest expiration time of the timers armed since wheel_next () */
+  uint32_t armed;                 /* # of timers currently armed              */
+  wtimer_t slots [WHEEL_LEVELS] [WHEEL_SLOTS];
+} wheel_t;
+
+
+void wheel_init (wheel_t * wheel, uint64_t tick);
+uint64_t wheel_clock (wheel_t * wheel);
+unsigned wheel_advance (wheel_t * wheel, uint64_t now);
+uint64_t wheel_next (wheel_t * wheel);
+
+void wtimer_init (wtimer_t * timer, wheel_cb_t * cb, void * arg);
+void wtimer_arm (wheel_t * wheel, wtimer_t * timer, uint64_t expires);
+void wtimer_cancel (wheel_t * wheel, wtimer_t * timer);
+int wtimer_armed (wtimer_t * timer);